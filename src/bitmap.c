@@ -33,8 +33,30 @@
  * SOFTWARE.
  */
 
+/* The AVX2 kernel is built for AVX2 whatever the compiler flags, and is only
+ * called if the CPU supports it. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BITMAP_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if defined(BITMAP_AVX2) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <stdbool.h>
+
 #include "bitmap.h"
 
+#ifdef BITMAP_AVX2
+/* whether the CPU supports AVX2, which is checked once at startup */
+static bool bitmap_avx2 = false;
+
+static void __attribute__((constructor)) bitmap_detect_avx2(void) {
+  __builtin_cpu_init();
+  bitmap_avx2 = __builtin_cpu_supports("avx2");
+}
+#endif
+
 void bitmap_init(bitmap_t *bitmap, int width, int height) {
   memset(bitmap, 0, sizeof(bitmap_t));
   bitmap->width = width;
@@ -43,11 +65,41 @@ void bitmap_init(bitmap_t *bitmap, int width, int height) {
   bitmap->priority = (uint8_t *)calloc(width * height, sizeof(uint8_t));
 }
 
+void bitmap_init_rgba(bitmap_t *bitmap, int width, int height,
+                      const uint32_t *palette) {
+  memset(bitmap, 0, sizeof(bitmap_t));
+  bitmap->width = width;
+  bitmap->height = height;
+  bitmap->priority = (uint8_t *)calloc(width * height, sizeof(uint8_t));
+  bitmap->rgba = (uint32_t *)calloc(width * height, sizeof(uint32_t));
+  bitmap->palette = palette;
+}
+
+void bitmap_set_palette(bitmap_t *bitmap, const uint32_t *palette) {
+  if (!palette) {
+    free(bitmap->rgba);
+    bitmap->rgba = 0;
+    bitmap->palette = 0;
+    return;
+  }
+
+  if (!bitmap->rgba) {
+    bitmap->rgba =
+        (uint32_t *)malloc(bitmap->width * bitmap->height * sizeof(uint32_t));
+  }
+
+  bitmap->palette = palette;
+  bitmap_apply_palette(bitmap, 0, bitmap->height, palette, bitmap->rgba,
+                       bitmap->width * 4);
+}
+
 void bitmap_shutdown(bitmap_t *bitmap) {
   free(bitmap->data);
   free(bitmap->priority);
+  free(bitmap->rgba);
   bitmap->data = 0;
   bitmap->priority = 0;
+  bitmap->rgba = 0;
 }
 
 uint16_t *bitmap_data(bitmap_t *bitmap, int x, int y) {
@@ -59,34 +111,236 @@ uint8_t *bitmap_priority(bitmap_t *bitmap, int x, int y) {
 }
 
 void bitmap_fill(bitmap_t *bitmap, uint16_t color) {
-  uint16_t *data = bitmap->data;
-  uint8_t *priority = bitmap->priority;
+  int pixels = bitmap->width * bitmap->height;
+
+  if (bitmap->data) {
+    uint16_t *data = bitmap->data;
+
+    for (int i = 0; i < pixels; i++) {
+      *data++ = color;
+    }
+  }
+
+  if (bitmap->rgba) {
+    uint32_t *rgba = bitmap->rgba;
+    uint32_t c = bitmap->palette[color];
+
+    for (int i = 0; i < pixels; i++) {
+      *rgba++ = c;
+    }
+  }
+
+  memset(bitmap->priority, 0, pixels);
+}
+
+#ifdef BITMAP_AVX2
+/**
+ * Converts the pixels of a row through the palette eight at a time with
+ * gathers, and returns the number of pixels converted.
+ */
+static BITMAP_AVX2 int bitmap_apply_palette_avx2(const uint16_t *src,
+                                                 const uint32_t *palette,
+                                                 uint32_t *out, int width) {
+  int x = 0;
+
+  for (; x + 8 <= width; x += 8) {
+    __m128i pens = _mm_loadu_si128((const __m128i *)(src + x));
+    __m256i colors = _mm256_i32gather_epi32(
+        (const int *)palette, _mm256_cvtepu16_epi32(pens), 4);
+
+    _mm256_storeu_si256((__m256i *)(out + x), colors);
+  }
+
+  return x;
+}
+#endif
+
+void bitmap_apply_palette(const bitmap_t *bitmap, int y, int height,
+                          const uint32_t *palette, uint32_t *dst, int pitch) {
+  for (int row = 0; row < height; row++) {
+    const uint16_t *src = bitmap->data + (y + row) * bitmap->width;
+    uint32_t *out = (uint32_t *)((uint8_t *)dst + row * pitch);
+    int x = 0;
+
+#ifdef BITMAP_AVX2
+    if (bitmap_avx2) {
+      x = bitmap_apply_palette_avx2(src, palette, out, bitmap->width);
+    }
+#endif
+
+    for (; x + 4 <= bitmap->width; x += 4) {
+      uint32_t a = palette[src[x]];
+      uint32_t b = palette[src[x + 1]];
+      uint32_t c = palette[src[x + 2]];
+      uint32_t d = palette[src[x + 3]];
+
+      out[x] = a;
+      out[x + 1] = b;
+      out[x + 2] = c;
+      out[x + 3] = d;
+    }
+
+    for (; x < bitmap->width; x++) {
+      out[x] = palette[src[x]];
+    }
+  }
+}
+
+void bitmap_read_rgba(const bitmap_t *bitmap, int y, int height, uint32_t *dst,
+                      int pitch) {
+  for (int row = 0; row < height; row++) {
+    const uint32_t *src = bitmap->rgba + (y + row) * bitmap->width;
+
+    memcpy((uint8_t *)dst + row * pitch, src, bitmap->width * 4);
+  }
+}
+
+#ifdef __SSE2__
+/**
+ * Selects the destination bytes where the mask is set, and the source bytes
+ * everywhere else.
+ */
+static inline __m128i bitmap_select(__m128i mask, __m128i src, __m128i dst) {
+  return _mm_or_si128(_mm_andnot_si128(mask, src), _mm_and_si128(mask, dst));
+}
+#endif
+
+/**
+ * Copies a span of pixels which have a non-zero priority.
+ *
+ * The pixels are selected under a mask of the zero priorities a vector at a
+ * time, so the copy doesn't branch on each pixel.
+ */
+static void bitmap_copy_span(const uint16_t *src_data,
+                             const uint8_t *src_priority, uint16_t *data,
+                             uint8_t *priority, int count) {
+  int i = 0;
+
+#ifdef __SSE2__
+  for (; i + 16 <= count; i += 16) {
+    __m128i *pri_ptr = (__m128i *)(priority + i);
+    __m128i *lo_ptr = (__m128i *)(data + i);
+    __m128i *hi_ptr = (__m128i *)(data + i + 8);
+
+    __m128i src_pri = _mm_loadu_si128((const __m128i *)(src_priority + i));
+    __m128i src_lo = _mm_loadu_si128((const __m128i *)(src_data + i));
+    __m128i src_hi = _mm_loadu_si128((const __m128i *)(src_data + i + 8));
+
+    /* widen the mask for the 16-bit pixels */
+    __m128i mask = _mm_cmpeq_epi8(src_pri, _mm_setzero_si128());
+    __m128i mask_lo = _mm_unpacklo_epi8(mask, mask);
+    __m128i mask_hi = _mm_unpackhi_epi8(mask, mask);
+
+    _mm_storeu_si128(pri_ptr,
+                     bitmap_select(mask, src_pri, _mm_loadu_si128(pri_ptr)));
+    _mm_storeu_si128(lo_ptr,
+                     bitmap_select(mask_lo, src_lo, _mm_loadu_si128(lo_ptr)));
+    _mm_storeu_si128(hi_ptr,
+                     bitmap_select(mask_hi, src_hi, _mm_loadu_si128(hi_ptr)));
+  }
+#endif
+
+  for (; i < count; i++) {
+    if (src_priority[i]) {
+      data[i] = src_data[i];
+      priority[i] = src_priority[i];
+    }
+  }
+}
+
+/**
+ * Copies a span of 32-bit colors which have a non-zero priority, in the same
+ * way as bitmap_copy_span.
+ */
+static void bitmap_copy_span_rgba(const uint32_t *src_rgba,
+                                  const uint8_t *src_priority, uint32_t *rgba,
+                                  uint8_t *priority, int count) {
+  int i = 0;
 
-  for (int i = 0; i < bitmap->width * bitmap->height; i++) {
-    *data++ = color;
-    *priority++ = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= count; i += 16) {
+    __m128i *pri_ptr = (__m128i *)(priority + i);
+    __m128i src_pri = _mm_loadu_si128((const __m128i *)(src_priority + i));
+    __m128i mask = _mm_cmpeq_epi8(src_pri, _mm_setzero_si128());
+    int transparent = _mm_movemask_epi8(mask);
+
+    if (transparent == 0xffff)
+      continue;
+
+    if (transparent == 0) {
+      memcpy(rgba + i, src_rgba + i, 16 * sizeof(uint32_t));
+      memcpy(priority + i, src_priority + i, 16);
+      continue;
+    }
+
+    __m128i mask_lo = _mm_unpacklo_epi8(mask, mask);
+    __m128i mask_hi = _mm_unpackhi_epi8(mask, mask);
+
+    /* widen the mask for each quarter of the 32-bit pixels */
+    __m128i masks[4] = {
+        _mm_unpacklo_epi16(mask_lo, mask_lo),
+        _mm_unpackhi_epi16(mask_lo, mask_lo),
+        _mm_unpacklo_epi16(mask_hi, mask_hi),
+        _mm_unpackhi_epi16(mask_hi, mask_hi),
+    };
+
+    for (int j = 0; j < 4; j++) {
+      __m128i *ptr = (__m128i *)(rgba + i + j * 4);
+      __m128i src = _mm_loadu_si128((const __m128i *)(src_rgba + i + j * 4));
+
+      _mm_storeu_si128(ptr,
+                       bitmap_select(masks[j], src, _mm_loadu_si128(ptr)));
+    }
+
+    _mm_storeu_si128(pri_ptr,
+                     bitmap_select(mask, src_pri, _mm_loadu_si128(pri_ptr)));
+  }
+#endif
+
+  for (; i < count; i++) {
+    if (src_priority[i]) {
+      rgba[i] = src_rgba[i];
+      priority[i] = src_priority[i];
+    }
   }
 }
 
 void bitmap_copy(bitmap_t *src, bitmap_t *dst, int scroll_x, int scroll_y) {
-  uint16_t *data = dst->data;
-  uint8_t *priority = dst->priority;
+  /* the scroll offsets are wrapped once, rather than for every pixel */
+  int wrapped_x = (scroll_x % src->width + src->width) % src->width;
+  int wrapped_y = (scroll_y % src->height + src->height) % src->height;
 
   for (int y = 0; y < dst->height; y++) {
-    for (int x = 0; x < dst->width; x++) {
-      /* Calculate the wrapped coordinates in tilemap space. Wrapping occurs
-       * when the visible area is outside of the tilemap. */
-      uint32_t wrapped_x = (x + scroll_x) % src->width;
-      uint32_t wrapped_y = (y + scroll_y) % src->height;
-      uint32_t addr = (wrapped_y * src->width) + wrapped_x;
-
-      if (src->priority[addr]) {
-        *data = src->data[addr];
-        *priority = src->priority[addr];
+    int src_y = (wrapped_y + y) % src->height;
+    int src_x = wrapped_x;
+    int x = 0;
+
+    /* Each row is split into contiguous spans of the source row. Wrapping
+     * occurs when the visible area is outside of the tilemap, so there are
+     * at most two spans unless the source is narrower than the destination. */
+    while (x < dst->width) {
+      int count = src->width - src_x;
+
+      if (count > dst->width - x) {
+        count = dst->width - x;
+      }
+
+      if (src->rgba && dst->rgba) {
+        bitmap_copy_span_rgba(src->rgba + src_y * src->width + src_x,
+                              bitmap_priority(src, src_x, src_y),
+                              dst->rgba + y * dst->width + x,
+                              bitmap_priority(dst, x, y), count);
+      }
+
+      if (src->data && dst->data) {
+        bitmap_copy_span(bitmap_data(src, src_x, src_y),
+                         bitmap_priority(src, src_x, src_y),
+                         bitmap_data(dst, x, y), bitmap_priority(dst, x, y),
+                         count);
       }
 
-      data++;
-      priority++;
+      x += count;
+      src_x = 0;
     }
   }
 }
@@ -44,24 +44,64 @@ typedef struct {
   int width;
   int height;
 
-  /* bitmap data */
+  /* bitmap data, which is NULL for a bitmap of 32-bit colors only */
   uint16_t *data;
 
   /* priority map */
   uint8_t *priority;
+
+  /* 32-bit color data, and the palette the colors are resolved through, which
+   * are NULL unless the bitmap has 32-bit colors */
+  uint32_t *rgba;
+  const uint32_t *palette;
 } bitmap_t;
 
 void bitmap_init(bitmap_t *bitmap, int width, int height);
 
+/**
+ * Initialises a bitmap of 32-bit colors only. Pixels drawn to it are resolved
+ * through the palette as they are drawn, rather than being stored as pens.
+ */
+void bitmap_init_rgba(bitmap_t *bitmap, int width, int height,
+                      const uint32_t *palette);
+
+/**
+ * Keeps 32-bit colors resolved through the palette alongside the pens, and
+ * resolves the pens which are already in the bitmap. The colors are removed
+ * if the palette is NULL.
+ */
+void bitmap_set_palette(bitmap_t *bitmap, const uint32_t *palette);
+
 void bitmap_shutdown(bitmap_t *bitmap);
 
 uint16_t *bitmap_data(bitmap_t *bitmap, int x, int y);
 
 uint8_t *bitmap_priority(bitmap_t *bitmap, int x, int y);
 
+/**
+ * Fills the bitmap with the given pen, and clears the priority map.
+ */
 void bitmap_fill(bitmap_t *bitmap, uint16_t color);
 
 /**
- * Copies a bitmap, respecting the priority of the pixels.
+ * Converts the given rows of the bitmap to 32-bit colors through the palette.
+ * The rows of the destination are pitch bytes apart.
+ *
+ * The pixels are looked up eight at a time with gathers if the CPU supports
+ * AVX2, otherwise the lookups are unrolled.
+ */
+void bitmap_apply_palette(const bitmap_t *bitmap, int y, int height,
+                          const uint32_t *palette, uint32_t *dst, int pitch);
+
+/**
+ * Copies the given rows of 32-bit colors from the bitmap. The rows of the
+ * destination are pitch bytes apart.
+ */
+void bitmap_read_rgba(const bitmap_t *bitmap, int y, int height, uint32_t *dst,
+                      int pitch);
+
+/**
+ * Copies a bitmap, respecting the priority of the pixels. The pens are copied
+ * if both bitmaps have pens, and the 32-bit colors if both have colors.
  */
 void bitmap_copy(bitmap_t *src, bitmap_t *dst, int scroll_x, int scroll_y);
@@ -0,0 +1,675 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stb_image_write.h"
+
+#include "netplay.h"
+#include "rewind.h"
+#include "rygar.h"
+
+/* the size of the rewind buffer */
+#define REWIND_CAPACITY (64 * 1024 * 1024)
+
+/* the number of times each palette resolve is run in the benchmark */
+#define PALETTE_BENCHMARK_RUNS 20000
+
+/* the padding of each row of the frame buffer in the benchmark (in pixels) */
+#define PALETTE_BENCHMARK_PADDING 16
+
+/* FNV-1a parameters */
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint32_t buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-n frames] [-e every] [-s] [-o dir] [-d] [-i] [-m] [-w]\n"
+          "          [-l file] [-S file] [-r frames] [-a frames] [-p file]\n"
+          "          [-N lat:loss] [-B file] [-t] [-R path] [-L] [-P]\n"
+          "          [-C] [-k] [-f]\n"
+          "\n"
+          "  -n frames  number of frames to run (default: 600, or the length\n"
+          "             of the movie)\n"
+          "  -e every   only hash/write every nth frame (default: 1)\n"
+          "  -s         print a hash of each frame\n"
+          "  -o dir     write each frame as a PNG file to the given directory\n"
+          "  -d         don't draw the frames, only run the CPU\n"
+          "  -i         use the instruction-stepped CPU core\n"
+          "  -m         use the instruction-stepped CPU core, with direct\n"
+          "             memory access for plain RAM and ROM\n"
+          "  -w         execute idle loops instead of skipping them\n"
+          "  -l file    load the machine state from the given file\n"
+          "  -S file    save the machine state to the given file at the end\n"
+          "  -r frames  rewind the given number of frames at the end, and\n"
+          "             check that running them again gives the same state\n"
+          "  -a frames  run the given number of frames ahead of each drawn\n"
+          "             frame\n"
+          "  -p file    play the input movie in the given file\n"
+          "  -N lat:loss\n"
+          "             test netplay between two machines over UDP on this\n"
+          "             host, with the given latency (in frames) and packet\n"
+          "             loss (in percent)\n"
+          "  -B file    boot from the boot cache in the given file, which is\n"
+          "             written if it doesn't match\n"
+          "  -t         check the packed tile decoder against the generic\n"
+          "             decoder, and time them\n"
+          "  -R path    load the ROMs from the given directory, or tar\n"
+          "             archive\n"
+          "  -L         decode each tile the first time it is drawn, when the\n"
+          "             tiles aren't built in\n"
+          "  -P         benchmark the palette resolve against a plain loop\n"
+          "             after the run\n"
+          "  -k         draw the sprites from a packed copy of the sprite ROM\n"
+          "  -f         draw flipped sprites from pre-flipped tiles\n"
+          "  -C         draw the layers with 32-bit colors, rather than\n"
+          "             resolving the frame through the palette\n",
+          name);
+}
+
+/**
+ * Returns the 64-bit FNV-1a hash of the frame buffer.
+ */
+static uint64_t hash_frame(const uint32_t *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint64_t hash = FNV_OFFSET_BASIS;
+
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Returns the scripted input of a player for the netplay test. The inputs
+ * change every few frames, and player 1 inserts a coin and starts the game.
+ */
+static netplay_input_t script_input(int player, uint64_t frame) {
+  uint32_t x = (uint32_t)(frame / 15) * 2654435761u ^ (player + 1) * 40503u;
+  x ^= x >> 13;
+  x *= 0x5bd1e995;
+  x ^= x >> 15;
+
+  netplay_input_t input = {.joystick = x & 0x0f, .buttons = (x >> 4) & 0x03};
+
+  if (player == 0 && frame >= 300 && frame < 310) {
+    input.sys = 1 << 2;
+  } else if (player == 0 && frame >= 400 && frame < 410) {
+    input.sys = 1 << 1;
+  }
+
+  return input;
+}
+
+/**
+ * Decodes the tile ROMs with both the packed and generic tile decoders, and
+ * checks that they give the same tiles.
+ */
+static int run_tile_decode_test() {
+  uint8_t *packed = malloc(TILE_ROMS_SIZE);
+  uint8_t *generic = malloc(TILE_ROMS_SIZE);
+  double start = now();
+
+  rygar_decode_tile_roms(packed, false);
+
+  double packed_time = now() - start;
+  start = now();
+
+  rygar_decode_tile_roms(generic, true);
+
+  double generic_time = now() - start;
+  bool ok = memcmp(packed, generic, TILE_ROMS_SIZE) == 0;
+
+  fprintf(stderr, "packed decoder: %.3fms, generic decoder: %.3fms\n",
+          packed_time * 1e3, generic_time * 1e3);
+  fprintf(stderr, "decoded tiles %s\n", ok ? "match" : "don't match");
+
+  free(packed);
+  free(generic);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Runs the machine for the given number of frames, then times resolving the
+ * last frame through the palette with bitmap_apply_palette against a plain
+ * loop over each pixel. The frame is resolved into a buffer with padded rows,
+ * and checked against the plain loop.
+ */
+static int run_palette_benchmark(long frames, rygar_cpu_mode_t cpu_mode) {
+  static uint32_t reference[SCREEN_WIDTH * SCREEN_HEIGHT];
+  static uint32_t padded[(SCREEN_WIDTH + PALETTE_BENCHMARK_PADDING) *
+                         SCREEN_HEIGHT];
+  int pitch = (SCREEN_WIDTH + PALETTE_BENCHMARK_PADDING) * sizeof(uint32_t);
+  rygar_t *rygar = rygar_create();
+
+  if (!rygar) {
+    fprintf(stderr, "couldn't create machine\n");
+    return EXIT_FAILURE;
+  }
+
+  rygar_set_cpu_mode(rygar, cpu_mode);
+
+  for (long frame = 0; frame < frames; frame++) {
+    rygar_run_frame(rygar, frame == frames - 1 ? buffer : NULL);
+  }
+
+  /* the visible area starts 16 lines down */
+  const uint16_t *data = bitmap_data(&rygar->bitmap, 0, 16);
+  double start = now();
+
+  for (int run = 0; run < PALETTE_BENCHMARK_RUNS; run++) {
+    for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+      reference[i] = rygar->palette[data[i]];
+    }
+  }
+
+  double plain_time = now() - start;
+  start = now();
+
+  for (int run = 0; run < PALETTE_BENCHMARK_RUNS; run++) {
+    bitmap_apply_palette(&rygar->bitmap, 16, SCREEN_HEIGHT, rygar->palette,
+                         padded, pitch);
+  }
+
+  double resolve_time = now() - start;
+  bool ok = true;
+
+  for (int y = 0; y < SCREEN_HEIGHT; y++) {
+    ok = ok && memcmp(&padded[y * pitch / sizeof(uint32_t)],
+                      &reference[y * SCREEN_WIDTH],
+                      SCREEN_WIDTH * sizeof(uint32_t)) == 0;
+  }
+
+  fprintf(stderr, "plain loop: %.1fus per frame, palette resolve: %.1fus "
+                  "per frame (%.2fx)\n",
+          plain_time / PALETTE_BENCHMARK_RUNS * 1e6,
+          resolve_time / PALETTE_BENCHMARK_RUNS * 1e6,
+          plain_time / resolve_time);
+  fprintf(stderr, "resolved frame %s\n", ok ? "matches" : "doesn't match");
+
+  rygar_destroy(rygar);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Copies the input registers of the machine, in the order they are recorded
+ * in a movie.
+ */
+static void get_inputs(const rygar_t *rygar, uint8_t *inputs) {
+  inputs[0] = rygar->main.joystick;
+  inputs[1] = rygar->main.buttons;
+  inputs[2] = rygar->main.sys;
+  inputs[3] = rygar->main.joystick2;
+  inputs[4] = rygar->main.buttons2;
+}
+
+/**
+ * Sets the input registers of the machine, in the order they are recorded in
+ * a movie.
+ */
+static void set_inputs(rygar_t *rygar, const uint8_t *inputs) {
+  rygar->main.joystick = inputs[0];
+  rygar->main.buttons = inputs[1];
+  rygar->main.sys = inputs[2];
+  rygar->main.joystick2 = inputs[3];
+  rygar->main.buttons2 = inputs[4];
+}
+
+/**
+ * Runs two machines against each other with netplay over UDP on this host, and
+ * checks their state hashes against a third machine, which is run with the
+ * real inputs of both players.
+ */
+static int run_netplay_test(long frames, rygar_cpu_mode_t cpu_mode,
+                            bool idle_skip, bool draw, int latency,
+                            int loss) {
+  rygar_t *machines[3];
+  netplay_t netplay[2];
+
+  for (int i = 0; i < 3; i++) {
+    machines[i] = rygar_create();
+
+    if (!machines[i]) {
+      fprintf(stderr, "couldn't create machine\n");
+      return EXIT_FAILURE;
+    }
+
+    rygar_set_cpu_mode(machines[i], cpu_mode);
+    rygar_set_idle_skip(machines[i], idle_skip);
+  }
+
+  for (int i = 0; i < 2; i++) {
+    if (!netplay_init(&netplay[i], machines[i], i, NETPLAY_PORT + i,
+                      "127.0.0.1", NETPLAY_PORT + 1 - i)) {
+      fprintf(stderr, "couldn't start netplay on port %d\n", NETPLAY_PORT + i);
+      return EXIT_FAILURE;
+    }
+
+    netplay_set_faults(&netplay[i], latency, loss, i + 1);
+  }
+
+  /* the reference state hashes at the start of each frame */
+  rygar_t *reference = machines[2];
+  size_t state_size = rygar_save_core_state(reference, NULL, 0);
+  uint8_t *state = malloc(state_size);
+  uint64_t *hashes = malloc((frames + 1) * sizeof(uint64_t));
+
+  for (long frame = 0; frame <= frames; frame++) {
+    netplay_input_t p1 = script_input(0, frame);
+    netplay_input_t p2 = script_input(1, frame);
+
+    rygar_save_core_state(reference, state, state_size);
+    hashes[frame] = netplay_hash(state, state_size);
+
+    reference->main.joystick = p1.joystick;
+    reference->main.buttons = p1.buttons;
+    reference->main.joystick2 = p2.joystick;
+    reference->main.buttons2 = p2.buttons;
+    reference->main.sys = p1.sys | p2.sys;
+    rygar_run_frame(reference, NULL);
+  }
+
+  /* run until the state at the end of the last frame is final on both peers,
+   * checking each final state against the reference */
+  long ticks = 0;
+  long checked = 0;
+  long mismatched = 0;
+  uint64_t verified[2] = {0, 0};
+  double start = now();
+
+  while (verified[0] <= frames || verified[1] <= frames) {
+    for (int i = 0; i < 2; i++) {
+      netplay_frame(&netplay[i], machines[i],
+                    script_input(i, netplay[i].frame),
+                    draw && i == 0 ? buffer : NULL);
+
+      uint64_t hash;
+
+      while (verified[i] <= frames &&
+             netplay_state_hash(&netplay[i], verified[i], &hash)) {
+        checked++;
+        mismatched += hash != hashes[verified[i]++];
+      }
+    }
+
+    ticks++;
+  }
+
+  double elapsed = now() - start;
+
+  fprintf(stderr, "%ld frames in %.3fs (%ld display frames)\n", frames,
+          elapsed, ticks);
+
+  for (int i = 0; i < 2; i++) {
+    netplay_t *n = &netplay[i];
+
+    fprintf(stderr,
+            "player %d: %llu rollbacks, %.1f frames resimulated per rollback "
+            "(max %llu), %llu stalls, %llu desyncs\n",
+            i + 1, (unsigned long long)n->rollbacks,
+            n->rollbacks ? (double)n->resimulated / n->rollbacks : 0.0,
+            (unsigned long long)n->max_resimulated,
+            (unsigned long long)n->stalls, (unsigned long long)n->desyncs);
+  }
+
+  fprintf(stderr, "%ld state hashes checked, %ld don't match\n", checked,
+          mismatched);
+
+  bool ok = !mismatched && !netplay[0].desyncs && !netplay[1].desyncs;
+
+  for (int i = 0; i < 2; i++) {
+    netplay_shutdown(&netplay[i]);
+  }
+
+  for (int i = 0; i < 3; i++) {
+    rygar_destroy(machines[i]);
+  }
+
+  free(state);
+  free(hashes);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[]) {
+  long frames = 0;
+  long every = 1;
+  long rewind_frames = 0;
+  long run_ahead = 0;
+  bool hash = false;
+  bool draw = true;
+  rygar_cpu_mode_t cpu_mode = RYGAR_CPU_CYCLE;
+  bool idle_skip = true;
+  const char *dir = NULL;
+  const char *load_path = NULL;
+  const char *save_path = NULL;
+  const char *movie_path = NULL;
+  const char *boot_path = NULL;
+  const char *rom_path = NULL;
+  movie_t movie = {0};
+  bool netplay = false;
+  bool tile_decode_test = false;
+  bool palette_benchmark = false;
+  bool rgba = false;
+  int latency = 0;
+  int loss = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:e:so:dimwl:S:r:a:p:N:B:tR:LPCkf")) !=
+         -1) {
+    switch (opt) {
+    case 'n':
+      frames = strtol(optarg, NULL, 10);
+      break;
+    case 'e':
+      every = strtol(optarg, NULL, 10);
+      break;
+    case 's':
+      hash = true;
+      break;
+    case 'o':
+      dir = optarg;
+      break;
+    case 'd':
+      draw = false;
+      break;
+    case 'i':
+      cpu_mode = RYGAR_CPU_INSTRUCTION;
+      break;
+    case 'm':
+      cpu_mode = RYGAR_CPU_DIRECT;
+      break;
+    case 'w':
+      idle_skip = false;
+      break;
+    case 'l':
+      load_path = optarg;
+      break;
+    case 'S':
+      save_path = optarg;
+      break;
+    case 'r':
+      rewind_frames = strtol(optarg, NULL, 10);
+      break;
+    case 'a':
+      run_ahead = strtol(optarg, NULL, 10);
+      break;
+    case 'p':
+      movie_path = optarg;
+      break;
+    case 'R':
+      rom_path = optarg;
+      break;
+    case 'P':
+      palette_benchmark = true;
+      break;
+    case 'L':
+      rygar_set_lazy_tiles(true);
+      break;
+    case 'C':
+      rgba = true;
+      break;
+    case 'k':
+      rygar_set_packed_tiles(true);
+      break;
+    case 'f':
+      rygar_set_flipped_sprites(true);
+      break;
+    case 't':
+      tile_decode_test = true;
+      break;
+    case 'B':
+      boot_path = optarg;
+      break;
+    case 'N':
+      netplay = sscanf(optarg, "%d:%d", &latency, &loss) == 2;
+
+      if (!netplay) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (movie_path) {
+    if (!movie_play(&movie, movie_path) || movie.cpu_mode > RYGAR_CPU_DIRECT) {
+      fprintf(stderr, "couldn't play movie: %s\n", movie_path);
+      return EXIT_FAILURE;
+    }
+
+    /* the movie only plays back the same with the core it was recorded on */
+    cpu_mode = movie.cpu_mode;
+  }
+
+  if (!frames) {
+    frames = movie_path ? movie.length : 600;
+  }
+
+  if (frames <= 0 || every <= 0 || rewind_frames < 0 || run_ahead < 0 ||
+      rewind_frames >= frames || (!draw && (hash || dir || run_ahead)) ||
+      (boot_path && (movie_path || netplay))) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (rom_path) {
+    const char *error;
+    double start = now();
+
+    if (!rygar_load_roms(rom_path, &error)) {
+      fprintf(stderr, "couldn't load ROMs from %s (%s)\n", rom_path, error);
+      return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "loaded ROMs in %.3fms\n", (now() - start) * 1e3);
+  }
+
+  if (tile_decode_test) {
+    return run_tile_decode_test();
+  }
+
+  if (palette_benchmark) {
+    return run_palette_benchmark(frames, cpu_mode);
+  }
+
+  if (netplay) {
+    return run_netplay_test(frames, cpu_mode, idle_skip, draw, latency, loss);
+  }
+
+  double boot_start = now();
+  rygar_t *rygar = boot_path ? rygar_boot(boot_path, cpu_mode) : rygar_create();
+
+  if (!rygar) {
+    fprintf(stderr, "couldn't create machine\n");
+    return EXIT_FAILURE;
+  }
+
+  if (boot_path) {
+    fprintf(stderr, "booted in %.3fms\n", (now() - boot_start) * 1e3);
+  }
+
+  rygar_set_cpu_mode(rygar, cpu_mode);
+
+  if (load_path && !rygar_load_state_file(rygar, load_path)) {
+    fprintf(stderr, "couldn't load state: %s\n", load_path);
+    rygar_destroy(rygar);
+    return EXIT_FAILURE;
+  }
+
+  rygar_set_idle_skip(rygar, idle_skip);
+  rygar_set_rgba(rygar, rgba);
+
+  rewind_t history;
+  size_t state_size = rygar_save_core_state(rygar, NULL, 0);
+  uint8_t *state = malloc(state_size);
+  uint8_t *final_state = malloc(state_size);
+  double capture = 0;
+
+  /* the inputs of the frames which can be rewound, so the rewound frames are
+   * run again with the same inputs */
+  uint8_t(*inputs)[MOVIE_INPUTS] =
+      malloc((rewind_frames ? rewind_frames : 1) * sizeof(*inputs));
+
+  if (!state || !final_state || !inputs ||
+      !rewind_init(&history, state_size,
+                   rewind_frames ? REWIND_CAPACITY : 0)) {
+    fprintf(stderr, "couldn't allocate the rewind buffer\n");
+    free(state);
+    free(final_state);
+    free(inputs);
+    rygar_destroy(rygar);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t skipped = 0;
+  double start = now();
+
+  for (long frame = 0; frame < frames; frame++) {
+    if (movie_path) {
+      rygar_movie_frame(rygar, &movie);
+    }
+
+    rygar_run_ahead(rygar, run_ahead, draw ? buffer : NULL);
+    skipped += rygar->skipped_ticks;
+
+    if (rewind_frames) {
+      double t = now();
+      rygar_save_core_state(rygar, state, state_size);
+      rewind_push(&history, state);
+      capture += now() - t;
+
+      get_inputs(rygar, inputs[frame % rewind_frames]);
+    }
+
+    if (!draw || frame % every != 0)
+      continue;
+
+    if (hash) {
+      printf("%ld %016llx\n", frame,
+             (unsigned long long)hash_frame(buffer, sizeof(buffer)));
+    }
+
+    if (dir) {
+      char filename[4096];
+      snprintf(filename, sizeof(filename), "%s/%06ld.png", dir, frame);
+
+      if (!stbi_write_png(filename, SCREEN_WIDTH, SCREEN_HEIGHT, 4, buffer,
+                          SCREEN_WIDTH * 4)) {
+        fprintf(stderr, "couldn't write frame: %s\n", filename);
+        rygar_destroy(rygar);
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  double elapsed = now() - start;
+
+  fprintf(stderr, "%ld frames in %.3fs (%.1f fps, %.2fx realtime)\n", frames,
+          elapsed, frames / elapsed, frames / elapsed / 60.0);
+  fprintf(stderr, "%.0f idle ticks skipped per frame (%.1f%%)\n",
+          (double)skipped / frames,
+          100.0 * skipped / ((double)frames * VSYNC_PERIOD_4MHZ));
+
+  if (rewind_frames) {
+    size_t used = rewind_used(&history);
+    long count = history.count;
+    bool ok = true;
+
+    fprintf(stderr,
+            "%ld frames of rewind in %.1f KB (%.0f bytes per frame), "
+            "%.1f us per frame to capture\n",
+            count, used / 1024.0, (double)used / (count - 1),
+            capture / frames * 1e6);
+
+    rygar_save_core_state(rygar, final_state, state_size);
+
+    for (long i = 0; i < rewind_frames; i++) {
+      ok = ok && rewind_pop(&history, state);
+    }
+
+    ok = ok && rygar_load_state(rygar, state, state_size);
+
+    for (long frame = frames - rewind_frames; frame < frames; frame++) {
+      set_inputs(rygar, inputs[frame % rewind_frames]);
+      rygar_run_frame(rygar, draw ? buffer : NULL);
+    }
+
+    rygar_save_core_state(rygar, state, state_size);
+
+    if (!ok || memcmp(state, final_state, state_size) != 0) {
+      fprintf(stderr, "rewound state doesn't match\n");
+      rygar_destroy(rygar);
+      return EXIT_FAILURE;
+    }
+  }
+
+  movie_close(&movie);
+  rewind_shutdown(&history);
+  free(state);
+  free(final_state);
+  free(inputs);
+
+  if (save_path && !rygar_save_state_file(rygar, save_path)) {
+    fprintf(stderr, "couldn't save state: %s\n", save_path);
+    rygar_destroy(rygar);
+    return EXIT_FAILURE;
+  }
+
+  rygar_destroy(rygar);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,387 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <SDL3/SDL_events.h>
+#include <SDL3/SDL_init.h>
+#include <SDL3/SDL_video.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SDL_MAIN_USE_CALLBACKS 1 /* use the callbacks instead of main() */
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h>
+
+#include "netplay.h"
+#include "rewind.h"
+#include "rygar.h"
+
+#define WIDTH 800
+#define HEIGHT 600
+
+/* the frame period of the emulated machine, in nanoseconds */
+#define FRAME_NS (SDL_NS_PER_SECOND / 60)
+
+/* the most frames that are run to catch up with the host clock */
+#define MAX_CATCH_UP_FRAMES 4
+
+/* the size of the rewind buffer, which holds several minutes of history */
+#define REWIND_CAPACITY (16 * 1024 * 1024)
+
+/* the host time at which the next frame is due */
+static uint64_t next_frame_ns;
+
+/* rewind history, and a buffer for the state being captured or restored */
+static rewind_t history;
+static uint8_t *rewind_state = NULL;
+static size_t rewind_state_size;
+
+/* true while the rewind key is held down */
+static bool rewinding = false;
+
+/* the number of frames to run ahead, set with the -a option */
+static int run_ahead = 0;
+
+/* the input movie being recorded or played, set with the -r and -p options */
+static movie_t movie;
+static bool movie_active = false;
+
+/* the netplay session, set up with the -n, -b, and -c options */
+static netplay_t netplay;
+static bool netplay_active = false;
+
+/* the local inputs from the keyboard */
+static netplay_input_t input;
+
+static rygar_t *rygar = NULL;
+static SDL_Window *window = NULL;
+static SDL_Renderer *renderer = NULL;
+static SDL_Texture *texture = NULL;
+
+/* This function runs once at startup. */
+SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
+  const char *record_path = NULL;
+  const char *play_path = NULL;
+  const char *peer = NULL;
+  const char *boot_path = NULL;
+  const char *rom_path = NULL;
+  int player = 1;
+  int port = NETPLAY_PORT;
+  bool rgba = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (SDL_strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+      run_ahead = SDL_atoi(argv[++i]);
+    } else if (SDL_strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (SDL_strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      play_path = argv[++i];
+    } else if (SDL_strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      player = SDL_atoi(argv[++i]);
+    } else if (SDL_strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+      port = SDL_atoi(argv[++i]);
+    } else if (SDL_strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      peer = argv[++i];
+    } else if (SDL_strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+      boot_path = argv[++i];
+    } else if (SDL_strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+      rom_path = argv[++i];
+    } else if (SDL_strcmp(argv[i], "-C") == 0) {
+      rgba = true;
+    } else {
+      SDL_Log("usage: %s [-a frames] [-r movie | -p movie] "
+              "[-n player -b port -c host:port] [-B cache] [-R roms] [-C]",
+              argv[0]);
+      return SDL_APP_FAILURE;
+    }
+  }
+
+  if (!SDL_CreateWindowAndRenderer("Hello World", WIDTH, HEIGHT,
+                                   SDL_WINDOW_RESIZABLE, &window, &renderer)) {
+    SDL_Log("Couldn't create window/renderer: %s", SDL_GetError());
+    return SDL_APP_FAILURE;
+  }
+
+  if (!SDL_SetWindowAspectRatio(window, 1.33, 1.33)) {
+    SDL_Log("Couldn't set aspect ratio: %s", SDL_GetError());
+    return SDL_APP_FAILURE;
+  }
+
+  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_XBGR8888,
+                              SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH,
+                              SCREEN_HEIGHT);
+
+  if (!texture) {
+    SDL_Log("Couldn't create streaming texture: %s", SDL_GetError());
+    return SDL_APP_FAILURE;
+  }
+
+  if (rom_path) {
+    const char *error;
+
+    if (!rygar_load_roms(rom_path, &error)) {
+      SDL_Log("Couldn't load ROMs from %s (%s)", rom_path, error);
+      return SDL_APP_FAILURE;
+    }
+  }
+
+  /* movies are played back from the moment the machine is switched on */
+  if (boot_path && (record_path || play_path)) {
+    SDL_Log("Movies can't be used with a boot cache");
+    return SDL_APP_FAILURE;
+  }
+
+  rygar = boot_path ? rygar_boot(boot_path, RYGAR_CPU_CYCLE) : rygar_create();
+
+  if (!rygar) {
+    SDL_Log("Couldn't create machine");
+    return SDL_APP_FAILURE;
+  }
+
+  rygar_set_rgba(rygar, rgba);
+
+  if (record_path) {
+    if (!movie_record(&movie, record_path, rygar->cpu_mode)) {
+      SDL_Log("Couldn't record movie: %s", record_path);
+      return SDL_APP_FAILURE;
+    }
+
+    movie_active = true;
+  } else if (play_path) {
+    if (!movie_play(&movie, play_path) || movie.cpu_mode > RYGAR_CPU_DIRECT) {
+      SDL_Log("Couldn't play movie: %s", play_path);
+      return SDL_APP_FAILURE;
+    }
+
+    rygar_set_cpu_mode(rygar, movie.cpu_mode);
+    movie_active = true;
+  }
+
+  if (peer) {
+    char host[256];
+    int remote_port;
+
+    if (SDL_sscanf(peer, "%255[^:]:%d", host, &remote_port) != 2 ||
+        (player != 1 && player != 2) ||
+        !netplay_init(&netplay, rygar, player - 1, port, host, remote_port)) {
+      SDL_Log("Couldn't start netplay with %s", peer);
+      return SDL_APP_FAILURE;
+    }
+
+    netplay_active = true;
+  }
+
+  rewind_state_size = rygar_save_core_state(rygar, NULL, 0);
+  rewind_state = malloc(rewind_state_size);
+
+  if (!rewind_state ||
+      !rewind_init(&history, rewind_state_size, REWIND_CAPACITY)) {
+    SDL_Log("Couldn't allocate the rewind buffer");
+    return SDL_APP_FAILURE;
+  }
+
+  return SDL_APP_CONTINUE;
+}
+
+/* This function runs when a new event (mouse input, keypresses, etc) occurs. */
+SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
+  switch (event->type) {
+  case SDL_EVENT_QUIT:
+    return SDL_APP_SUCCESS;
+  case SDL_EVENT_KEY_DOWN:
+    switch (event->key.scancode) {
+    case SDL_SCANCODE_LEFT:
+      input.joystick |= (1 << 0);
+      break;
+    case SDL_SCANCODE_RIGHT:
+      input.joystick |= (1 << 1);
+      break;
+    case SDL_SCANCODE_DOWN:
+      input.joystick |= (1 << 2);
+      break;
+    case SDL_SCANCODE_UP:
+      input.joystick |= (1 << 3);
+      break;
+    case SDL_SCANCODE_Z:
+      input.buttons |= (1 << 0);
+      break; /* attack */
+    case SDL_SCANCODE_X:
+      input.buttons |= (1 << 1);
+      break; /* jump */
+    case SDL_SCANCODE_5:
+      input.sys |= (1 << 2);
+      break; /* player 1 coin */
+    case SDL_SCANCODE_1:
+      input.sys |= (1 << 1);
+      break; /* player 1 start */
+    case SDL_SCANCODE_P:
+      rygar->capture = true;
+      break; /* capture */
+    case SDL_SCANCODE_BACKSPACE:
+      rewinding = true;
+      break; /* rewind */
+    default:
+      break;
+    }
+    break;
+
+  case SDL_EVENT_KEY_UP:
+    switch (event->key.scancode) {
+    case SDL_SCANCODE_LEFT:
+      input.joystick &= ~(1 << 0);
+      break;
+    case SDL_SCANCODE_RIGHT:
+      input.joystick &= ~(1 << 1);
+      break;
+    case SDL_SCANCODE_DOWN:
+      input.joystick &= ~(1 << 2);
+      break;
+    case SDL_SCANCODE_UP:
+      input.joystick &= ~(1 << 3);
+      break;
+    case SDL_SCANCODE_Z:
+      input.buttons &= ~(1 << 0);
+      break; /* attack */
+    case SDL_SCANCODE_X:
+      input.buttons &= ~(1 << 1);
+      break; /* jump */
+    case SDL_SCANCODE_5:
+      input.sys &= ~(1 << 2);
+      break; /* player 1 coin */
+    case SDL_SCANCODE_1:
+      input.sys &= ~(1 << 1);
+      break; /* player 1 start */
+    case SDL_SCANCODE_BACKSPACE:
+      rewinding = false;
+      break; /* rewind */
+    default:
+      break;
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  return SDL_APP_CONTINUE;
+}
+
+/* Runs the next frame, or steps back a frame while rewinding. Rewinding is
+ * disabled while a movie is recorded or played, as it would break the run,
+ * and netplay does its own rolling back. */
+static void run_frame(uint32_t *pixels) {
+  if (netplay_active) {
+    /* the machine is left as it is while waiting for the other player */
+    if (!netplay_frame(&netplay, rygar, input, pixels) && pixels) {
+      rygar_draw(rygar, pixels);
+    }
+  } else if (rewinding && !movie_active) {
+    if (rewind_pop(&history, rewind_state)) {
+      rygar_load_state(rygar, rewind_state, rewind_state_size);
+    }
+
+    if (pixels) {
+      rygar_draw(rygar, pixels);
+    }
+  } else {
+    rygar->main.joystick = input.joystick;
+    rygar->main.buttons = input.buttons;
+    rygar->main.sys = input.sys;
+
+    if (movie_active && !rygar_movie_frame(rygar, &movie)) {
+      SDL_Log("Movie ended");
+      movie_close(&movie);
+      movie_active = false;
+    }
+
+    rygar_run_ahead(rygar, run_ahead, pixels);
+    rygar_save_core_state(rygar, rewind_state, rewind_state_size);
+    rewind_push(&history, rewind_state);
+  }
+}
+
+/* This function runs once per frame, and is the heart of the program. */
+SDL_AppResult SDL_AppIterate(void *appstate) {
+  uint64_t now_ns = SDL_GetTicksNS();
+  uint32_t *pixels;
+  int pitch;
+
+  if (now_ns < next_frame_ns) {
+    SDL_DelayNS(next_frame_ns - now_ns);
+    return SDL_APP_CONTINUE;
+  }
+
+  /* if the host has fallen too far behind, then the emulation is slowed down
+   * instead of dropping emulated time */
+  if (now_ns - next_frame_ns > MAX_CATCH_UP_FRAMES * FRAME_NS) {
+    next_frame_ns = now_ns;
+  }
+
+  /* catch up with the host clock, only drawing the last frame */
+  while (now_ns - next_frame_ns >= FRAME_NS) {
+    run_frame(NULL);
+    next_frame_ns += FRAME_NS;
+  }
+
+  if (!SDL_LockTexture(texture, NULL, (void **)&pixels, &pitch)) {
+    SDL_Log("Couldn't lock texture: %s", SDL_GetError());
+    return SDL_APP_FAILURE;
+  }
+
+  /* the frame is drawn straight into the texture */
+  rygar_set_pitch(rygar, pitch);
+  run_frame(pixels);
+  next_frame_ns += FRAME_NS;
+
+  SDL_UnlockTexture(texture);
+  SDL_RenderTexture(renderer, texture, NULL, NULL);
+  SDL_RenderPresent(renderer);
+
+  return SDL_APP_CONTINUE;
+}
+
+/* This function runs once at shutdown. */
+void SDL_AppQuit(void *appstate, SDL_AppResult result) {
+  if (movie_active && !movie_close(&movie)) {
+    SDL_Log("Couldn't write movie");
+  }
+
+  if (netplay_active) {
+    netplay_shutdown(&netplay);
+  }
+
+  rewind_shutdown(&history);
+  free(rewind_state);
+  rygar_destroy(rygar);
+}
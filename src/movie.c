@@ -0,0 +1,221 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "movie.h"
+#include "state.h"
+
+/* the size of the file header */
+#define HEADER_SIZE 6
+
+/* a LEB128 number up to 64 bits */
+#define MAX_VARINT_SIZE 10
+
+static void movie_write_record(movie_t *movie, uint64_t delta, uint8_t mask,
+                               const uint8_t *inputs) {
+  uint8_t record[MAX_VARINT_SIZE + 1 + MOVIE_INPUTS];
+  size_t n = 0;
+
+  do {
+    record[n++] = (delta & 0x7f) | (delta > 0x7f ? 0x80 : 0);
+    delta >>= 7;
+  } while (delta);
+
+  record[n++] = mask;
+
+  for (int i = 0; i < MOVIE_INPUTS; i++) {
+    if (mask & (1 << i)) {
+      record[n++] = inputs[i];
+    }
+  }
+
+  fwrite(record, 1, n, movie->file);
+}
+
+/**
+ * Reads the frame delta of the next record. Returns false at the end of the
+ * movie.
+ */
+static bool movie_read_delta(movie_t *movie, uint64_t *delta) {
+  uint64_t value = 0;
+
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (movie->pos >= movie->size) {
+      return false;
+    }
+
+    uint8_t byte = movie->data[movie->pos++];
+    value |= (uint64_t)(byte & 0x7f) << shift;
+
+    if (!(byte & 0x80)) {
+      *delta = value;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Reads the changes of the record, and applies them to the given registers.
+ * Returns false if the record is truncated.
+ */
+static bool movie_read_changes(movie_t *movie, uint8_t *inputs) {
+  if (movie->pos >= movie->size) {
+    return false;
+  }
+
+  uint8_t mask = movie->data[movie->pos++];
+
+  for (int i = 0; i < MOVIE_INPUTS; i++) {
+    if (mask & (1 << i)) {
+      if (movie->pos >= movie->size) {
+        return false;
+      }
+
+      inputs[i] = movie->data[movie->pos++];
+    }
+  }
+
+  return true;
+}
+
+bool movie_record(movie_t *movie, const char *path, uint8_t cpu_mode) {
+  uint8_t header[HEADER_SIZE] = {0, 0, 0, 0, MOVIE_VERSION, cpu_mode};
+
+  memcpy(header, MOVIE_MAGIC, 4);
+  memset(movie, 0, sizeof(movie_t));
+  movie->file = fopen(path, "wb");
+  movie->cpu_mode = cpu_mode;
+
+  if (!movie->file) {
+    return false;
+  }
+
+  fwrite(header, 1, HEADER_SIZE, movie->file);
+
+  return true;
+}
+
+bool movie_play(movie_t *movie, const char *path) {
+  uint8_t inputs[MOVIE_INPUTS] = {0};
+  uint64_t delta;
+
+  memset(movie, 0, sizeof(movie_t));
+  movie->data = state_map_file(path, &movie->size);
+
+  if (!movie->data) {
+    return false;
+  }
+
+  if (movie->size < HEADER_SIZE ||
+      memcmp(movie->data, MOVIE_MAGIC, 4) != 0 ||
+      movie->data[4] != MOVIE_VERSION) {
+    movie_close(movie);
+    return false;
+  }
+
+  movie->cpu_mode = movie->data[5];
+
+  /* find the length of the movie, up to the last complete record */
+  movie->pos = HEADER_SIZE;
+
+  while (movie_read_delta(movie, &delta) &&
+         movie_read_changes(movie, inputs)) {
+    movie->length += delta;
+  }
+
+  movie->pos = HEADER_SIZE;
+  movie->next = movie_read_delta(movie, &delta) ? delta : UINT64_MAX;
+
+  return true;
+}
+
+bool movie_frame(movie_t *movie, uint8_t *inputs) {
+  if (movie->file) {
+    uint8_t mask = 0;
+
+    for (int i = 0; i < MOVIE_INPUTS; i++) {
+      if (inputs[i] != movie->inputs[i]) {
+        mask |= 1 << i;
+      }
+    }
+
+    if (mask) {
+      movie_write_record(movie, movie->frame - movie->next, mask, inputs);
+      memcpy(movie->inputs, inputs, MOVIE_INPUTS);
+      movie->next = movie->frame;
+    }
+
+    movie->frame++;
+    return true;
+  }
+
+  if (!movie->data || movie->frame >= movie->length) {
+    return false;
+  }
+
+  while (movie->frame == movie->next) {
+    uint64_t delta;
+
+    movie_read_changes(movie, movie->inputs);
+    movie->next = movie_read_delta(movie, &delta) ? movie->next + delta
+                                                  : UINT64_MAX;
+  }
+
+  memcpy(inputs, movie->inputs, MOVIE_INPUTS);
+  movie->frame++;
+
+  return true;
+}
+
+bool movie_close(movie_t *movie) {
+  bool ok = true;
+
+  if (movie->file) {
+    /* mark the end of the movie */
+    movie_write_record(movie, movie->frame - movie->next, 0, movie->inputs);
+    ok = fclose(movie->file) == 0;
+  }
+
+  if (movie->data) {
+    state_unmap_file(movie->data, movie->size);
+  }
+
+  memset(movie, 0, sizeof(movie_t));
+
+  return ok;
+}
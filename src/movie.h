@@ -0,0 +1,114 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* An input movie records the input registers of the machine on every frame,
+ * so a run can be played back exactly. The inputs are only sampled between
+ * frames, so the same inputs always produce the same run.
+ *
+ * The file is a header followed by a list of records:
+ *
+ *   header: "RYGM" magic, u8 version, u8 CPU core mode
+ *   record: frame delta (LEB128), change mask, changed register values
+ *
+ * Each record gives the number of frames since the previous record, and the
+ * new values of the registers which changed on that frame, one bit per
+ * register in the mask. Runs of frames without any changes cost nothing, and
+ * the last record, which may have an empty mask, marks the end of the movie.
+ * The records are written as they happen, so a movie is still valid up to the
+ * last change if the recording is cut short. */
+
+/* magic number at the start of the file */
+#define MOVIE_MAGIC "RYGM"
+
+/* movie format version */
+#define MOVIE_VERSION 2
+
+/* the recorded registers: joystick, buttons, sys, and the player 2 joystick
+ * and buttons */
+#define MOVIE_INPUTS 5
+
+typedef struct {
+  /* the file being recorded */
+  FILE *file;
+
+  /* the movie being played */
+  const uint8_t *data;
+  size_t size;
+  size_t pos;
+
+  /* the CPU core mode the movie was recorded with */
+  uint8_t cpu_mode;
+
+  /* the current frame, and the frame of the next record */
+  uint64_t frame;
+  uint64_t next;
+
+  /* the length of the movie being played, in frames */
+  uint64_t length;
+
+  /* the current register values */
+  uint8_t inputs[MOVIE_INPUTS];
+} movie_t;
+
+/**
+ * Starts recording a movie to the given file. Returns false if the file
+ * couldn't be created.
+ */
+bool movie_record(movie_t *movie, const char *path, uint8_t cpu_mode);
+
+/**
+ * Starts playing the movie in the given file. Returns false if the file
+ * doesn't contain a valid movie.
+ */
+bool movie_play(movie_t *movie, const char *path);
+
+/**
+ * Records the registers for the next frame, or replaces them with the
+ * recorded values when playing. Returns false if the movie has ended.
+ */
+bool movie_frame(movie_t *movie, uint8_t *inputs);
+
+/**
+ * Stops recording or playing the movie. Returns false if the recording
+ * couldn't be written.
+ */
+bool movie_close(movie_t *movie);
@@ -0,0 +1,458 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "netplay.h"
+
+/* magic number at the start of each packet */
+#define PACKET_MAGIC "RYGN"
+
+/* sent in place of the hash frame before any frames have been hashed */
+#define NO_HASH 0xffffffff
+
+/* FNV-1a parameters */
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+#define HISTORY_MASK (NETPLAY_HISTORY - 1)
+
+/*
+ * Packets are encoded in little-endian byte order.
+ */
+
+static void put32(uint8_t *p, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = value >> (i * 8);
+  }
+}
+
+static void put64(uint8_t *p, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    p[i] = value >> (i * 8);
+  }
+}
+
+static uint32_t get32(const uint8_t *p) {
+  uint32_t value = 0;
+
+  for (int i = 0; i < 4; i++) {
+    value |= (uint32_t)p[i] << (i * 8);
+  }
+
+  return value;
+}
+
+static uint64_t get64(const uint8_t *p) {
+  uint64_t value = 0;
+
+  for (int i = 0; i < 8; i++) {
+    value |= (uint64_t)p[i] << (i * 8);
+  }
+
+  return value;
+}
+
+uint64_t netplay_hash(const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint64_t hash = FNV_OFFSET_BASIS;
+
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static bool netplay_same_input(netplay_input_t a, netplay_input_t b) {
+  return a.joystick == b.joystick && a.buttons == b.buttons && a.sys == b.sys;
+}
+
+/**
+ * Returns the saved state for the start of the given frame.
+ */
+static uint8_t *netplay_state(netplay_t *netplay, uint64_t frame) {
+  return netplay->states + (frame % NETPLAY_WINDOW) * netplay->state_size;
+}
+
+/**
+ * Returns a pseudo-random number, used to simulate packet loss.
+ */
+static uint32_t netplay_random(netplay_t *netplay) {
+  uint32_t x = netplay->random;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+
+  return netplay->random = x;
+}
+
+bool netplay_init(netplay_t *netplay, rygar_t *rygar, int player,
+                  uint16_t port, const char *host, uint16_t remote_port) {
+  struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+  struct addrinfo *result;
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_port = htons(port),
+                             .sin_addr.s_addr = htonl(INADDR_ANY)};
+  char service[8];
+
+  memset(netplay, 0, sizeof(netplay_t));
+  netplay->player = player;
+  netplay->rollback = UINT64_MAX;
+  netplay->remote_hash_frame = UINT64_MAX;
+  netplay->socket = -1;
+
+  snprintf(service, sizeof(service), "%u", remote_port);
+
+  if (getaddrinfo(host, service, &hints, &result) != 0) {
+    return false;
+  }
+
+  memcpy(&netplay->peer, result->ai_addr, sizeof(struct sockaddr_in));
+  freeaddrinfo(result);
+
+  netplay->socket = socket(AF_INET, SOCK_DGRAM, 0);
+
+  if (netplay->socket < 0 ||
+      bind(netplay->socket, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      fcntl(netplay->socket, F_SETFL, O_NONBLOCK) != 0) {
+    netplay_shutdown(netplay);
+    return false;
+  }
+
+  netplay->state_size = rygar_save_core_state(rygar, NULL, 0);
+  netplay->states = (uint8_t *)malloc(NETPLAY_WINDOW * netplay->state_size);
+  netplay->delayed = (netplay_packet_t *)malloc(NETPLAY_MAX_DELAYED *
+                                                sizeof(netplay_packet_t));
+
+  if (!netplay->states || !netplay->delayed) {
+    netplay_shutdown(netplay);
+    return false;
+  }
+
+  return true;
+}
+
+void netplay_shutdown(netplay_t *netplay) {
+  if (netplay->socket >= 0) {
+    close(netplay->socket);
+  }
+
+  free(netplay->states);
+  free(netplay->delayed);
+  netplay->socket = -1;
+  netplay->states = NULL;
+  netplay->delayed = NULL;
+}
+
+void netplay_set_faults(netplay_t *netplay, int latency, int loss,
+                        uint32_t seed) {
+  netplay->latency = latency;
+  netplay->loss = loss;
+  netplay->random = seed ? seed : 1;
+}
+
+/**
+ * Sends a packet, or holds it back if latency is being simulated.
+ */
+static void netplay_send(netplay_t *netplay, const uint8_t *data,
+                         size_t size) {
+  if (netplay->loss && netplay_random(netplay) % 100 < netplay->loss) {
+    return;
+  }
+
+  if (netplay->latency && netplay->delayed_count < NETPLAY_MAX_DELAYED) {
+    netplay_packet_t *packet = &netplay->delayed[netplay->delayed_count++];
+    packet->due = netplay->ticks + netplay->latency;
+    packet->size = size;
+    memcpy(packet->data, data, size);
+    return;
+  }
+
+  sendto(netplay->socket, data, size, 0, (struct sockaddr *)&netplay->peer,
+         sizeof(netplay->peer));
+}
+
+/**
+ * Sends the packets which have been held back long enough.
+ */
+static void netplay_send_delayed(netplay_t *netplay) {
+  int n = 0;
+
+  for (int i = 0; i < netplay->delayed_count; i++) {
+    netplay_packet_t *packet = &netplay->delayed[i];
+
+    if (packet->due <= netplay->ticks) {
+      sendto(netplay->socket, packet->data, packet->size, 0,
+             (struct sockaddr *)&netplay->peer, sizeof(netplay->peer));
+    } else {
+      netplay->delayed[n++] = *packet;
+    }
+  }
+
+  netplay->delayed_count = n;
+}
+
+/**
+ * Sends the local inputs which haven't been acknowledged yet, along with the
+ * latest state hash.
+ */
+static void netplay_send_inputs(netplay_t *netplay) {
+  uint8_t data[NETPLAY_MAX_PACKET];
+  uint64_t count = netplay->frame - netplay->acked;
+
+  if (count > NETPLAY_MAX_INPUTS) {
+    count = NETPLAY_MAX_INPUTS;
+  }
+
+  memcpy(data, PACKET_MAGIC, 4);
+  put32(data + 4, netplay->acked);
+  put32(data + 8, netplay->remote_count);
+  data[12] = count;
+
+  uint8_t *p = data + 13;
+
+  for (uint64_t i = 0; i < count; i++) {
+    netplay_input_t *input =
+        &netplay->local[(netplay->acked + i) & HISTORY_MASK];
+    *p++ = input->joystick;
+    *p++ = input->buttons;
+    *p++ = input->sys;
+  }
+
+  if (netplay->hashed) {
+    uint64_t frame = netplay->hashed - 1;
+    put32(p, frame);
+    put64(p + 4, netplay->hashes[frame & HISTORY_MASK]);
+  } else {
+    put32(p, NO_HASH);
+    put64(p + 4, 0);
+  }
+
+  netplay_send(netplay, data, p + 12 - data);
+}
+
+/**
+ * Handles a packet from the other peer.
+ */
+static void netplay_receive(netplay_t *netplay, const uint8_t *data,
+                            size_t size) {
+  if (size < 13 || memcmp(data, PACKET_MAGIC, 4) != 0 ||
+      size != 13 + data[12] * 3 + 12) {
+    return;
+  }
+
+  uint64_t first = get32(data + 4);
+  uint64_t ack = get32(data + 8);
+  const uint8_t *p = data + 13;
+
+  if (ack > netplay->acked && ack <= netplay->frame) {
+    netplay->acked = ack;
+  }
+
+  for (int i = 0; i < data[12]; i++, p += 3) {
+    uint64_t frame = first + i;
+    netplay_input_t input = {p[0], p[1], p[2]};
+
+    /* only the next unknown input is taken, so they stay contiguous */
+    if (frame != netplay->remote_count ||
+        frame >= netplay->frame + NETPLAY_HISTORY - NETPLAY_WINDOW) {
+      continue;
+    }
+
+    netplay_input_t *remote = &netplay->remote[frame & HISTORY_MASK];
+
+    /* the frame has already been run with a predicted input */
+    if (frame < netplay->frame && !netplay_same_input(*remote, input) &&
+        frame < netplay->rollback) {
+      netplay->rollback = frame;
+    }
+
+    *remote = input;
+    netplay->remote_count++;
+  }
+
+  if (get32(p) != NO_HASH) {
+    netplay->remote_hash_frame = get32(p);
+    netplay->remote_hash = get64(p + 4);
+  }
+}
+
+/**
+ * Receives all the pending packets.
+ */
+static void netplay_poll(netplay_t *netplay) {
+  uint8_t data[NETPLAY_MAX_PACKET];
+  ssize_t size;
+
+  while ((size = recv(netplay->socket, data, sizeof(data), 0)) >= 0) {
+    netplay_receive(netplay, data, size);
+  }
+}
+
+/**
+ * Sets the input registers for the given frame, predicting the remote input
+ * if it isn't known yet.
+ */
+static void netplay_apply_inputs(netplay_t *netplay, rygar_t *rygar,
+                                 uint64_t frame) {
+  netplay_input_t local = netplay->local[frame & HISTORY_MASK];
+  netplay_input_t *remote = &netplay->remote[frame & HISTORY_MASK];
+
+  if (frame >= netplay->remote_count) {
+    static const netplay_input_t none = {0};
+
+    *remote = netplay->remote_count
+                  ? netplay->remote[(netplay->remote_count - 1) & HISTORY_MASK]
+                  : none;
+  }
+
+  netplay_input_t p1 = netplay->player == 0 ? local : *remote;
+  netplay_input_t p2 = netplay->player == 0 ? *remote : local;
+
+  rygar->main.joystick = p1.joystick;
+  rygar->main.buttons = p1.buttons;
+  rygar->main.joystick2 = p2.joystick;
+  rygar->main.buttons2 = p2.buttons;
+  rygar->main.sys = p1.sys | p2.sys;
+}
+
+/**
+ * Restores the state at the start of the earliest mispredicted frame, and
+ * runs the frames since then again with the corrected inputs.
+ */
+static void netplay_resimulate(netplay_t *netplay, rygar_t *rygar) {
+  uint64_t count = netplay->frame - netplay->rollback;
+
+  rygar_load_state(rygar, netplay_state(netplay, netplay->rollback),
+                   netplay->state_size);
+
+  for (uint64_t frame = netplay->rollback; frame < netplay->frame; frame++) {
+    if (frame > netplay->rollback) {
+      rygar_save_core_state(rygar, netplay_state(netplay, frame),
+                            netplay->state_size);
+    }
+
+    netplay_apply_inputs(netplay, rygar, frame);
+    rygar_run_frame(rygar, NULL);
+  }
+
+  netplay->rollback = UINT64_MAX;
+  netplay->rollbacks++;
+  netplay->resimulated += count;
+
+  if (count > netplay->max_resimulated) {
+    netplay->max_resimulated = count;
+  }
+}
+
+/**
+ * Hashes the states which have become final, and checks the hash received
+ * from the other peer.
+ */
+static void netplay_check_hashes(netplay_t *netplay) {
+  while (netplay->hashed <= netplay->remote_count &&
+         netplay->hashed < netplay->frame) {
+    uint64_t frame = netplay->hashed++;
+    netplay->hashes[frame & HISTORY_MASK] = netplay_hash(
+        netplay_state(netplay, frame), netplay->state_size);
+  }
+
+  uint64_t frame = netplay->remote_hash_frame;
+  uint64_t hash;
+
+  if (frame != UINT64_MAX && frame >= netplay->checked &&
+      netplay_state_hash(netplay, frame, &hash)) {
+    if (hash != netplay->remote_hash) {
+      netplay->desyncs++;
+    }
+
+    netplay->checked = frame + 1;
+  }
+}
+
+bool netplay_frame(netplay_t *netplay, rygar_t *rygar, netplay_input_t input,
+                   uint32_t *buffer) {
+  netplay->ticks++;
+  netplay_send_delayed(netplay);
+  netplay_poll(netplay);
+
+  if (netplay->rollback != UINT64_MAX) {
+    netplay_resimulate(netplay, rygar);
+  }
+
+  netplay_check_hashes(netplay);
+
+  /* wait for the remote inputs to catch up, rather than overwriting the
+   * oldest state that might still be needed */
+  if (netplay->frame >= netplay->remote_count + NETPLAY_WINDOW) {
+    netplay->stalls++;
+    netplay_send_inputs(netplay);
+    return false;
+  }
+
+  uint64_t frame = netplay->frame;
+
+  rygar_save_core_state(rygar, netplay_state(netplay, frame),
+                        netplay->state_size);
+  netplay->local[frame & HISTORY_MASK] = input;
+  netplay_apply_inputs(netplay, rygar, frame);
+  rygar_run_frame(rygar, buffer);
+  netplay->frame++;
+
+  netplay_send_inputs(netplay);
+
+  return true;
+}
+
+bool netplay_state_hash(const netplay_t *netplay, uint64_t frame,
+                        uint64_t *hash) {
+  if (frame >= netplay->hashed || netplay->hashed - frame > NETPLAY_HISTORY) {
+    return false;
+  }
+
+  *hash = netplay->hashes[frame & HISTORY_MASK];
+
+  return true;
+}
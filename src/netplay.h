@@ -0,0 +1,199 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rygar.h"
+
+/* Two player netplay with rollback.
+ *
+ * Each peer runs its own machine. The local inputs are applied straight away,
+ * and sent to the other peer over UDP. Until the remote inputs for a frame
+ * arrive, they are predicted to be the same as the last ones received. When
+ * the real inputs turn out to be different, the machine is rolled back to the
+ * state saved at the start of that frame, and the frames since then are run
+ * again, without drawing them.
+ *
+ * Once all the inputs before a frame are known, the state at the start of the
+ * frame is final, and its hash is sent to the other peer to detect any
+ * desyncs.
+ *
+ * Every packet carries all the local inputs which the other peer hasn't
+ * acknowledged yet, so a lost packet is made up for by the next one. */
+
+/* the default UDP port */
+#define NETPLAY_PORT 7000
+
+/* the number of frames the remote inputs can be predicted ahead, before the
+ * local machine has to wait for them */
+#define NETPLAY_WINDOW 8
+
+/* the number of frames of inputs and hashes kept, this must be a power of
+ * two */
+#define NETPLAY_HISTORY 64
+
+/* the most inputs sent in a single packet */
+#define NETPLAY_MAX_INPUTS 32
+
+/* the largest packet */
+#define NETPLAY_MAX_PACKET (13 + NETPLAY_MAX_INPUTS * 3 + 12)
+
+/* the most packets held back to simulate latency */
+#define NETPLAY_MAX_DELAYED 256
+
+/* the inputs of one player for one frame */
+typedef struct {
+  uint8_t joystick;
+  uint8_t buttons;
+
+  /* the coin and start buttons, which are shared by both players */
+  uint8_t sys;
+} netplay_input_t;
+
+/* a packet held back to simulate latency */
+typedef struct {
+  uint64_t due;
+  size_t size;
+  uint8_t data[NETPLAY_MAX_PACKET];
+} netplay_packet_t;
+
+typedef struct {
+  /* the local player, 0 or 1 */
+  int player;
+
+  /* the UDP socket, and the address of the other peer */
+  int socket;
+  struct sockaddr_in peer;
+
+  /* the next frame to run */
+  uint64_t frame;
+
+  /* the local inputs, and the remote inputs used for each frame, which are
+   * predicted for the frames after remote_count */
+  netplay_input_t local[NETPLAY_HISTORY];
+  netplay_input_t remote[NETPLAY_HISTORY];
+
+  /* the number of frames for which the remote inputs are known */
+  uint64_t remote_count;
+
+  /* the number of local inputs the other peer has received */
+  uint64_t acked;
+
+  /* the earliest frame which was run with the wrong inputs, or UINT64_MAX */
+  uint64_t rollback;
+
+  /* the machine state at the start of each frame in the prediction window */
+  uint8_t *states;
+  size_t state_size;
+
+  /* the state hashes of the final frames, and the number of frames hashed */
+  uint64_t hashes[NETPLAY_HISTORY];
+  uint64_t hashed;
+
+  /* the last hash received from the other peer (UINT64_MAX if there isn't
+   * one), and the frame after the last one which was checked */
+  uint64_t remote_hash;
+  uint64_t remote_hash_frame;
+  uint64_t checked;
+
+  /* the simulated latency (in frames) and packet loss (in percent) */
+  int latency;
+  int loss;
+  uint32_t random;
+
+  /* the packets held back to simulate latency */
+  netplay_packet_t *delayed;
+  int delayed_count;
+
+  /* the number of calls to netplay_frame */
+  uint64_t ticks;
+
+  /* statistics */
+  uint64_t rollbacks;
+  uint64_t resimulated;
+  uint64_t max_resimulated;
+  uint64_t stalls;
+  uint64_t desyncs;
+} netplay_t;
+
+/**
+ * Starts a netplay session for the given local player (0 or 1), listening on
+ * the given UDP port and sending to the other peer at the given host and port.
+ * Both peers must start from the same machine state. Returns false if the
+ * socket couldn't be set up.
+ */
+bool netplay_init(netplay_t *netplay, rygar_t *rygar, int player,
+                  uint16_t port, const char *host, uint16_t remote_port);
+
+/**
+ * Ends the netplay session.
+ */
+void netplay_shutdown(netplay_t *netplay);
+
+/**
+ * Simulates a bad network by holding back the packets sent for the given
+ * number of frames, and dropping the given percentage of them. This is used
+ * to test netplay between two peers on the same host.
+ */
+void netplay_set_faults(netplay_t *netplay, int latency, int loss,
+                        uint32_t seed);
+
+/**
+ * Runs the next frame with the given local input, rolling back first if any
+ * remote inputs were mispredicted, and draws the frame to the buffer unless
+ * it is NULL.
+ *
+ * Returns false if the frame couldn't be run, because the remote inputs are
+ * too far behind. The caller should try again on the next display frame.
+ */
+bool netplay_frame(netplay_t *netplay, rygar_t *rygar, netplay_input_t input,
+                   uint32_t *buffer);
+
+/**
+ * Returns the hash of the final state at the start of the given frame, if it
+ * is still in the history.
+ */
+bool netplay_state_hash(const netplay_t *netplay, uint64_t frame,
+                        uint64_t *hash);
+
+/**
+ * Returns the 64-bit FNV-1a hash of a machine state.
+ */
+uint64_t netplay_hash(const void *data, size_t size);
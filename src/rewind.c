@@ -0,0 +1,303 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+
+/* the size of the length fields around each entry */
+#define LENGTH_SIZE sizeof(uint32_t)
+
+/* The differences are encoded as a sequence of runs, each made up of a 16-bit
+ * count of zero bytes, a 16-bit count of literal bytes, and the literal bytes.
+ * Zero runs shorter than this are stored as literals, as they cost more than
+ * they save. */
+#define MIN_ZERO_RUN 8
+
+#define MAX_RUN 0xffff
+
+/**
+ * Returns the worst case size of an encoded difference.
+ */
+static size_t rewind_max_code_size(size_t size) {
+  return size + (size / MAX_RUN + 2) * 4;
+}
+
+/**
+ * XORs two buffers into the destination buffer.
+ */
+static void rewind_xor(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+                       size_t size) {
+  size_t i = 0;
+
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t x, y;
+    memcpy(&x, a + i, sizeof(uint64_t));
+    memcpy(&y, b + i, sizeof(uint64_t));
+    x ^= y;
+    memcpy(dst + i, &x, sizeof(uint64_t));
+  }
+
+  for (; i < size; i++) {
+    dst[i] = a[i] ^ b[i];
+  }
+}
+
+/**
+ * Returns the length of the run of zero bytes at the start of the buffer, up
+ * to the given limit.
+ */
+static size_t rewind_zero_run(const uint8_t *data, size_t limit) {
+  size_t n = 0;
+
+  while (n + sizeof(uint64_t) <= limit) {
+    uint64_t x;
+    memcpy(&x, data + n, sizeof(uint64_t));
+
+    if (x) {
+      break;
+    }
+
+    n += sizeof(uint64_t);
+  }
+
+  while (n < limit && !data[n]) {
+    n++;
+  }
+
+  return n;
+}
+
+/**
+ * Run-length encodes the zero bytes in the buffer, and returns the size of
+ * the encoded data.
+ */
+static size_t rewind_encode(uint8_t *code, const uint8_t *data, size_t size) {
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < size) {
+    uint16_t zeros = rewind_zero_run(data + in, size - in < MAX_RUN
+                                                     ? size - in
+                                                     : MAX_RUN);
+    in += zeros;
+
+    /* extend the literals up to the next worthwhile run of zeros */
+    size_t start = in;
+
+    while (in < size && in - start < MAX_RUN) {
+      if (data[in]) {
+        in++;
+        continue;
+      }
+
+      size_t limit = size - in < MIN_ZERO_RUN ? size - in : MIN_ZERO_RUN;
+      size_t n = rewind_zero_run(data + in, limit);
+
+      if (n == MIN_ZERO_RUN) {
+        break;
+      }
+
+      in += n;
+    }
+
+    uint16_t literals = (in - start) < MAX_RUN ? in - start : MAX_RUN;
+    in = start + literals;
+
+    memcpy(code + out, &zeros, 2);
+    memcpy(code + out + 2, &literals, 2);
+    memcpy(code + out + 4, data + start, literals);
+    out += 4 + literals;
+  }
+
+  return out;
+}
+
+/**
+ * XORs the encoded difference into the buffer.
+ */
+static void rewind_decode(uint8_t *data, const uint8_t *code, size_t size) {
+  size_t in = 0;
+  size_t out = 0;
+
+  while (in < size) {
+    uint16_t zeros, literals;
+
+    memcpy(&zeros, code + in, 2);
+    memcpy(&literals, code + in + 2, 2);
+    in += 4;
+    out += zeros;
+
+    for (uint16_t i = 0; i < literals; i++) {
+      data[out++] ^= code[in++];
+    }
+  }
+}
+
+/**
+ * Copies data into the ring buffer at the given position, wrapping around at
+ * the end.
+ */
+static void rewind_ring_write(rewind_t *rewind, size_t pos, const void *data,
+                              size_t size) {
+  size_t n = rewind->capacity - pos < size ? rewind->capacity - pos : size;
+
+  memcpy(rewind->ring + pos, data, n);
+  memcpy(rewind->ring, (const uint8_t *)data + n, size - n);
+}
+
+/**
+ * Copies data out of the ring buffer at the given position, wrapping around at
+ * the end.
+ */
+static void rewind_ring_read(const rewind_t *rewind, size_t pos, void *data,
+                             size_t size) {
+  size_t n = rewind->capacity - pos < size ? rewind->capacity - pos : size;
+
+  memcpy(data, rewind->ring + pos, n);
+  memcpy((uint8_t *)data + n, rewind->ring, size - n);
+}
+
+bool rewind_init(rewind_t *rewind, size_t size, size_t capacity) {
+  memset(rewind, 0, sizeof(rewind_t));
+  rewind->size = size;
+  rewind->state = (uint8_t *)malloc(size);
+  rewind->diff = (uint8_t *)malloc(size);
+  rewind->code = (uint8_t *)malloc(rewind_max_code_size(size));
+  rewind->ring = (uint8_t *)malloc(capacity);
+  rewind->capacity = capacity;
+
+  /* an empty ring may not be allocated at all */
+  if (!rewind->state || !rewind->diff || !rewind->code ||
+      (capacity && !rewind->ring)) {
+    rewind_shutdown(rewind);
+    return false;
+  }
+
+  return true;
+}
+
+void rewind_shutdown(rewind_t *rewind) {
+  free(rewind->state);
+  free(rewind->diff);
+  free(rewind->code);
+  free(rewind->ring);
+  memset(rewind, 0, sizeof(rewind_t));
+}
+
+void rewind_clear(rewind_t *rewind) {
+  rewind->head = 0;
+  rewind->tail = 0;
+  rewind->used = 0;
+  rewind->count = 0;
+}
+
+/**
+ * Drops the oldest entry from the ring buffer.
+ */
+static void rewind_drop(rewind_t *rewind) {
+  uint32_t length;
+
+  rewind_ring_read(rewind, rewind->tail, &length, LENGTH_SIZE);
+  length += 2 * LENGTH_SIZE;
+  rewind->tail = (rewind->tail + length) % rewind->capacity;
+  rewind->used -= length;
+  rewind->count--;
+}
+
+void rewind_push(rewind_t *rewind, const void *state) {
+  if (rewind->count == 0) {
+    memcpy(rewind->state, state, rewind->size);
+    rewind->count = 1;
+    return;
+  }
+
+  /* the difference which turns the new state back into the previous one */
+  rewind_xor(rewind->diff, rewind->state, (const uint8_t *)state,
+             rewind->size);
+  memcpy(rewind->state, state, rewind->size);
+
+  uint32_t length = rewind_encode(rewind->code, rewind->diff, rewind->size);
+  size_t entry = length + 2 * LENGTH_SIZE;
+
+  if (entry > rewind->capacity) {
+    /* the history is lost, but the newest state is still kept */
+    rewind_clear(rewind);
+    rewind->count = 1;
+    return;
+  }
+
+  while (rewind->capacity - rewind->used < entry) {
+    rewind_drop(rewind);
+  }
+
+  /* the length is stored at both ends, so the ring can be walked from either
+   * end */
+  size_t pos = rewind->head;
+  rewind_ring_write(rewind, pos, &length, LENGTH_SIZE);
+  pos = (pos + LENGTH_SIZE) % rewind->capacity;
+  rewind_ring_write(rewind, pos, rewind->code, length);
+  pos = (pos + length) % rewind->capacity;
+  rewind_ring_write(rewind, pos, &length, LENGTH_SIZE);
+
+  rewind->head = (pos + LENGTH_SIZE) % rewind->capacity;
+  rewind->used += entry;
+  rewind->count++;
+}
+
+bool rewind_pop(rewind_t *rewind, void *state) {
+  uint32_t length;
+
+  if (rewind->count < 2) {
+    return false;
+  }
+
+  size_t capacity = rewind->capacity;
+  size_t pos = (rewind->head + capacity - LENGTH_SIZE) % capacity;
+
+  rewind_ring_read(rewind, pos, &length, LENGTH_SIZE);
+  pos = (pos + capacity - length) % capacity;
+  rewind_ring_read(rewind, pos, rewind->code, length);
+  rewind_decode(rewind->state, rewind->code, length);
+
+  rewind->head = (pos + capacity - LENGTH_SIZE) % capacity;
+  rewind->used -= length + 2 * LENGTH_SIZE;
+  rewind->count--;
+
+  memcpy(state, rewind->state, rewind->size);
+
+  return true;
+}
@@ -0,0 +1,108 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The rewind buffer keeps a history of fixed-size machine states.
+ *
+ * Only the newest state is kept whole. Every older state is stored as the
+ * difference from the state after it, which is XORed and run-length encoded.
+ * Since most of the state is unchanged from one frame to the next, the
+ * differences are mostly zeros and encode to a small fraction of a state.
+ *
+ * The encoded differences are kept in a ring buffer. When it is full, the
+ * oldest differences are dropped to make room for new ones. */
+
+typedef struct {
+  /* the size of a state */
+  size_t size;
+
+  /* the newest state */
+  uint8_t *state;
+
+  /* scratch buffers used to encode and decode the differences */
+  uint8_t *diff;
+  uint8_t *code;
+
+  /* the ring buffer of encoded differences, from the oldest at the tail to
+   * the newest at the head */
+  uint8_t *ring;
+  size_t capacity;
+  size_t head;
+  size_t tail;
+  size_t used;
+
+  /* the number of states in the buffer */
+  size_t count;
+} rewind_t;
+
+/**
+ * Initialises a rewind buffer for states of the given size, which keeps as
+ * many states as fit into the given number of bytes. Returns false if the
+ * buffers couldn't be allocated.
+ */
+bool rewind_init(rewind_t *rewind, size_t size, size_t capacity);
+
+/**
+ * Frees the resources used by the rewind buffer.
+ */
+void rewind_shutdown(rewind_t *rewind);
+
+/**
+ * Removes all the states from the rewind buffer.
+ */
+void rewind_clear(rewind_t *rewind);
+
+/**
+ * Adds a new state to the rewind buffer.
+ */
+void rewind_push(rewind_t *rewind, const void *state);
+
+/**
+ * Removes the newest state from the rewind buffer, and copies the state before
+ * it to the given buffer. Returns false if there is no earlier state.
+ */
+bool rewind_pop(rewind_t *rewind, void *state);
+
+/**
+ * Returns the number of bytes used by the encoded differences.
+ */
+static inline size_t rewind_used(const rewind_t *rewind) {
+  return rewind->used;
+}
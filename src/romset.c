@@ -0,0 +1,194 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "romset.h"
+#include "state.h"
+
+/* the size of the blocks in a tar archive */
+#define TAR_BLOCK_SIZE 512
+
+/* offsets of the fields in a tar header */
+#define TAR_NAME 0
+#define TAR_NAME_SIZE 100
+#define TAR_SIZE 124
+#define TAR_SIZE_SIZE 12
+#define TAR_TYPE 156
+
+/* CRC-32 lookup table for a nibble at a time (reflected 0x04c11db7) */
+static const uint32_t crc_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+    0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+uint32_t romset_crc32(uint32_t crc, const void *data, size_t size) {
+  const uint8_t *bytes = data;
+
+  crc = ~crc;
+
+  for (size_t i = 0; i < size; i++) {
+    crc ^= bytes[i];
+    crc = crc_table[crc & 0x0f] ^ (crc >> 4);
+    crc = crc_table[crc & 0x0f] ^ (crc >> 4);
+  }
+
+  return ~crc;
+}
+
+/**
+ * Adds a mapped file to the ROM set, so it is unmapped with the set.
+ */
+static bool romset_add_map(romset_t *romset, const void *data, size_t size) {
+  if (romset->map_count == ROMSET_MAX_FILES) {
+    state_unmap_file(data, size);
+    return false;
+  }
+
+  romset->maps[romset->map_count] = data;
+  romset->map_sizes[romset->map_count] = size;
+  romset->map_count++;
+
+  return true;
+}
+
+/**
+ * Finds a file in a tar archive by name, ignoring any directories. Returns
+ * NULL if the file isn't in the archive.
+ */
+static const uint8_t *romset_find_tar(const uint8_t *tar, size_t tar_size,
+                                      const char *name, size_t *size) {
+  size_t pos = 0;
+
+  /* the archive ends with an empty block */
+  while (pos + TAR_BLOCK_SIZE <= tar_size && tar[pos] != 0) {
+    const uint8_t *header = tar + pos;
+    char path[TAR_NAME_SIZE + 1];
+    char octal[TAR_SIZE_SIZE + 1];
+
+    memcpy(path, header + TAR_NAME, TAR_NAME_SIZE);
+    path[TAR_NAME_SIZE] = 0;
+    memcpy(octal, header + TAR_SIZE, TAR_SIZE_SIZE);
+    octal[TAR_SIZE_SIZE] = 0;
+
+    size_t file_size = 0;
+
+    if (sscanf(octal, "%zo", &file_size) != 1 ||
+        file_size > tar_size - pos - TAR_BLOCK_SIZE) {
+      return NULL;
+    }
+
+    const char *base = strrchr(path, '/');
+    bool regular = header[TAR_TYPE] == '0' || header[TAR_TYPE] == 0;
+
+    if (regular && strcmp(base ? base + 1 : path, name) == 0) {
+      *size = file_size;
+      return header + TAR_BLOCK_SIZE;
+    }
+
+    /* the file data is padded to a whole number of blocks */
+    pos += TAR_BLOCK_SIZE +
+           (file_size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+  }
+
+  return NULL;
+}
+
+bool romset_load(romset_t *romset, const char *path,
+                 const romset_file_t *files, int count) {
+  const uint8_t *tar = NULL;
+  size_t tar_size = 0;
+  struct stat st;
+
+  memset(romset, 0, sizeof(romset_t));
+
+  /* the path itself is reported if it can't be read */
+  romset->error = path;
+
+  if (count > ROMSET_MAX_FILES || stat(path, &st) != 0) {
+    return false;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    tar = state_map_file(path, &tar_size);
+
+    if (!tar || !romset_add_map(romset, tar, tar_size)) {
+      return false;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    const uint8_t *data;
+    size_t size = 0;
+
+    if (tar) {
+      data = romset_find_tar(tar, tar_size, files[i].name, &size);
+    } else {
+      char file_path[4096];
+
+      snprintf(file_path, sizeof(file_path), "%s/%s", path, files[i].name);
+      data = state_map_file(file_path, &size);
+
+      if (data && !romset_add_map(romset, data, size)) {
+        data = NULL;
+      }
+    }
+
+    /* the data is checked where it is mapped, so it is only read once */
+    if (!data || size != files[i].size ||
+        romset_crc32(0, data, size) != files[i].crc) {
+      romset_unload(romset);
+      romset->error = files[i].name;
+      return false;
+    }
+
+    romset->data[i] = data;
+  }
+
+  romset->error = NULL;
+
+  return true;
+}
+
+void romset_unload(romset_t *romset) {
+  for (int i = 0; i < romset->map_count; i++) {
+    state_unmap_file(romset->maps[i], romset->map_sizes[i]);
+  }
+
+  memset(romset, 0, sizeof(romset_t));
+}
@@ -0,0 +1,89 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* the maximum number of files in a ROM set */
+#define ROMSET_MAX_FILES 32
+
+/* a file in a ROM set */
+typedef struct {
+  const char *name;
+
+  /* the expected size and CRC-32 of the file */
+  size_t size;
+  uint32_t crc;
+} romset_file_t;
+
+/* A ROM set loaded at runtime. The files are mapped into memory read-only and
+ * used in place, so every process using the same files shares one copy of
+ * them through the page cache. */
+typedef struct {
+  /* the data of each file, in the order they were given */
+  const uint8_t *data[ROMSET_MAX_FILES];
+
+  /* the mapped files, an archive is mapped as a whole */
+  const void *maps[ROMSET_MAX_FILES];
+  size_t map_sizes[ROMSET_MAX_FILES];
+  int map_count;
+
+  /* the name of the file which couldn't be loaded, or the path of the ROM set
+   * if it couldn't be read at all */
+  const char *error;
+} romset_t;
+
+/**
+ * Loads the given files from a directory, or from an uncompressed tar
+ * archive. Returns false if a file is missing, or doesn't match its size and
+ * CRC-32, in which case the name of the file is set in error. Files in an
+ * archive are matched by name, ignoring any directories.
+ */
+bool romset_load(romset_t *romset, const char *path,
+                 const romset_file_t *files, int count);
+
+/**
+ * Unmaps the files of a ROM set.
+ */
+void romset_unload(romset_t *romset);
+
+/**
+ * Updates a CRC-32 with the given data. The CRC of a whole file is found by
+ * starting with zero, and updating it with each part of the file in turn.
+ */
+uint32_t romset_crc32(uint32_t crc, const void *data, size_t size);
@@ -33,18 +33,12 @@
  * SOFTWARE.
  */
 
-#include <SDL3/SDL_events.h>
-#include <SDL3/SDL_init.h>
-#include <SDL3/SDL_video.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
-
-#define SDL_MAIN_USE_CALLBACKS 1 /* use the callbacks instead of main() */
-#include <SDL3/SDL.h>
-#include <SDL3/SDL_main.h>
+#include <stdlib.h>
 
 #define CHIPS_IMPL
-#include "chips/clk.h"
 #include "chips/mem.h"
 #include "chips/z80.h"
 
@@ -53,49 +47,16 @@
 
 #include "bitmap.h"
 #include "roms/rygar-roms.h"
+#ifdef RYGAR_DECODED_TILES
+#include "roms/rygar-tiles.h"
+#endif
+#include "romset.h"
+#include "rygar.h"
 #include "sprite.h"
+#include "state.h"
 #include "tile.h"
 #include "tilemap.h"
-
-#define BETWEEN(n, a, b) ((n >= a) && (n <= b))
-
-#define CHAR_ROM_SIZE 0x10000
-#define FG_ROM_SIZE 0x40000
-#define BG_ROM_SIZE 0x40000
-#define SPRITE_ROM_SIZE 0x40000
-
-#define WORK_RAM_SIZE 0x1000
-#define WORK_RAM_START 0xc000
-#define WORK_RAM_END (WORK_RAM_START + WORK_RAM_SIZE - 1)
-
-#define CHAR_RAM_SIZE 0x800
-#define CHAR_RAM_START 0xd000
-#define CHAR_RAM_END (CHAR_RAM_START + CHAR_RAM_SIZE - 1)
-
-#define FG_RAM_SIZE 0x400
-#define FG_RAM_START 0xd800
-#define FG_RAM_END (FG_RAM_START + FG_RAM_SIZE - 1)
-
-#define BG_RAM_SIZE 0x400
-#define BG_RAM_START 0xdc00
-#define BG_RAM_END (BG_RAM_START + BG_RAM_SIZE - 1)
-
-#define SPRITE_RAM_SIZE 0x800
-#define SPRITE_RAM_START 0xe000
-#define SPRITE_RAM_END (SPRITE_RAM_START + SPRITE_RAM_SIZE - 1)
-
-#define PALETTE_RAM_SIZE 0x800
-#define PALETTE_RAM_START 0xe800
-#define PALETTE_RAM_END (PALETTE_RAM_START + PALETTE_RAM_SIZE - 1)
-
-#define RAM_SIZE 0x3000
-#define RAM_START 0xc000
-#define RAM_END (RAM_START + RAM_SIZE - 1)
-
-#define BANK_SIZE 0x8000
-#define BANK_WINDOW_SIZE 0x800
-#define BANK_WINDOW_START 0xf000
-#define BANK_WINDOW_END (BANK_WINDOW_START + BANK_WINDOW_SIZE - 1)
+#include "z80step.h"
 
 /* inputs */
 #define JOYSTICK1 0xf800
@@ -119,83 +80,135 @@
 #define FLIP_SCREEN 0xf807
 #define BANK_SWITCH 0xf808
 
-#define BUFFER_WIDTH 256
-#define BUFFER_HEIGHT 256
+/* the I/O registers are decoded in the page at 0xf800 */
+#define IO_PAGE_START 0xf800
+#define IO_REGISTERS 16
+
+/* the bank window is mapped on its own memory layer, below the fixed memory */
+#define BANK_LAYER 1
 
-#define SCREEN_WIDTH 256
-#define SCREEN_HEIGHT 224
+/* the maximum size (in bytes) of an idle loop */
+#define IDLE_LOOP_SIZE 16
+
+/* the maximum time (in ticks) to watch a candidate idle loop iteration */
+#define IDLE_PROBE_TICKS 256
 
 /* The tilemap horizontal scroll values are all offset by a fixed value, to
  * compensate for the back porch region of the CRT horizontal timing. We don't
  * need to include this offset in our scroll values, so we must correct it. */
 #define SCROLL_OFFSET 48
 
-#define CPU_FREQ 6000000
-#define VSYNC_PERIOD_4MHZ (CPU_FREQ / 60)
-#define VBLANK_DURATION_4MHZ (((CPU_FREQ / 60) / 525) * (525 - 483))
-
-#define WIDTH 800
-#define HEIGHT 600
-
-typedef struct {
-  z80_t cpu;
-  mem_t mem;
-
-  uint64_t pins;
-
-  /* ram */
-  uint8_t work_ram[WORK_RAM_SIZE];
-  uint8_t char_ram[CHAR_RAM_SIZE];
-  uint8_t fg_ram[FG_RAM_SIZE];
-  uint8_t bg_ram[BG_RAM_SIZE];
-  uint8_t sprite_ram[SPRITE_RAM_SIZE];
-  uint8_t palette_ram[PALETTE_RAM_SIZE];
-
-  /* bank switched rom */
-  uint8_t banked_rom[BANK_SIZE];
-  uint8_t current_bank;
-
-  /* tile roms */
-  uint8_t char_rom[CHAR_ROM_SIZE];
-  uint8_t fg_rom[FG_ROM_SIZE];
-  uint8_t bg_rom[BG_ROM_SIZE];
-  uint8_t sprite_rom[SPRITE_ROM_SIZE];
-
-  /* input registers */
-  uint8_t joystick;
-  uint8_t buttons;
-  uint8_t sys;
-
-  /* tilemap scroll offset registers */
-  uint8_t fg_scroll[3];
-  uint8_t bg_scroll[3];
-} mainboard_t;
-
-typedef struct {
-  mainboard_t main;
-
-  bitmap_t bitmap;
-
-  /* tilemaps */
-  tilemap_t char_tilemap;
-  tilemap_t fg_tilemap;
-  tilemap_t bg_tilemap;
-
-  /* 32-bit RGBA color palette cache */
-  uint32_t palette[1024];
-
-  /* counters */
-  int vsync_count;
-  int vblank_count;
-
-  bool capture;
-} rygar_t;
-
-static uint32_t prev_ticks;
-static rygar_t rygar;
-static SDL_Window *window = NULL;
-static SDL_Renderer *renderer = NULL;
-static SDL_Texture *texture = NULL;
+/* scheduler event types */
+enum { EVENT_VBLANK_START, EVENT_VBLANK_END };
+
+/* the ROM files, in the order of rygar-roms.yml */
+enum {
+  ROM_5P,
+  ROM_CPU_5J,
+  ROM_CPU_5M,
+  ROM_CPU_8K,
+  ROM_VID_6B,
+  ROM_VID_6C,
+  ROM_VID_6E,
+  ROM_VID_6F,
+  ROM_VID_6G,
+  ROM_VID_6H,
+  ROM_VID_6J,
+  ROM_VID_6K,
+  ROM_VID_6L,
+  ROM_VID_6N,
+  ROM_VID_6O,
+  ROM_VID_6P,
+  ROM_COUNT
+};
+
+/* the expected sizes and CRCs of the ROM files */
+static const romset_file_t rom_files[ROM_COUNT] = {
+    {"5.5p", 0x8000, 0x062cd55d},       {"cpu_5j.bin", 0x8000, 0xed76d606},
+    {"cpu_5m.bin", 0x4000, 0x7ac5191b}, {"cpu_8k.bin", 0x8000, 0x4d482fb6},
+    {"vid_6b.bin", 0x8000, 0x35389a7b}, {"vid_6c.bin", 0x8000, 0x89868c85},
+    {"vid_6e.bin", 0x8000, 0xff65e074}, {"vid_6f.bin", 0x8000, 0x9840edd8},
+    {"vid_6g.bin", 0x8000, 0x45839c9a}, {"vid_6h.bin", 0x8000, 0x46d9e7df},
+    {"vid_6j.bin", 0x8000, 0xae1f2ed6}, {"vid_6k.bin", 0x8000, 0xaba6db9e},
+    {"vid_6l.bin", 0x8000, 0x3cea7eaa}, {"vid_6n.bin", 0x8000, 0x7b12cf3f},
+    {"vid_6o.bin", 0x8000, 0x5a10a396}, {"vid_6p.bin", 0x8000, 0x9eae5f8e},
+};
+
+/* the ROMs in use, which are the ROMs built into the binary unless a ROM set
+ * has been loaded */
+static const uint8_t *roms[ROM_COUNT] = {
+    dump_5,      dump_cpu_5j, dump_cpu_5m, dump_cpu_8k,
+    dump_vid_6b, dump_vid_6c, dump_vid_6e, dump_vid_6f,
+    dump_vid_6g, dump_vid_6h, dump_vid_6j, dump_vid_6k,
+    dump_vid_6l, dump_vid_6n, dump_vid_6o, dump_vid_6p,
+};
+
+/* the ROM set loaded at runtime */
+static romset_t romset;
+static bool romset_loaded = false;
+
+/* decode descriptor for a 8x8 tile */
+static const tile_decode_desc_t tile_decode_8x8 = {
+    .tile_width = 8,
+    .tile_height = 8,
+    .planes = 4,
+    .plane_offsets = {STEP4(0, 1)},
+    .x_offsets = {STEP8(0, 4)},
+    .y_offsets = {STEP8(0, 4 * 8)},
+    .tile_size = 4 * 8, /* 32 bytes */
+};
+
+/* decode descriptor for a 16x16 tile, made up of four 8x8 tiles */
+static const tile_decode_desc_t tile_decode_16x16 = {
+    .tile_width = 16,
+    .tile_height = 16,
+    .planes = 4,
+    .plane_offsets = {STEP4(0, 1)},
+    .x_offsets = {STEP8(0, 4), STEP8(4 * 8 * 8, 4)},
+    .y_offsets = {STEP8(0, 4 * 8), STEP8(4 * 8 * 8 * 2, 4 * 8)},
+    .tile_size = 4 * 4 * 8, /* 128 bytes */
+};
+
+/* the tile roms, and the ROM chips they are decoded from */
+enum { CHAR_TILES, FG_TILES, BG_TILES, SPRITE_TILES, TILE_ROM_COUNT };
+
+static const struct {
+  const tile_decode_desc_t *desc;
+  int count;
+  int banks[TILE_MAX_BANKS];
+  int bank_count;
+} tile_rom_layouts[TILE_ROM_COUNT] = {
+    {&tile_decode_8x8, 1024, {ROM_CPU_8K}, 1},
+    {&tile_decode_16x16, 1024, {ROM_VID_6P, ROM_VID_6O, ROM_VID_6N, ROM_VID_6L},
+     4},
+    {&tile_decode_16x16, 1024, {ROM_VID_6F, ROM_VID_6E, ROM_VID_6C, ROM_VID_6B},
+     4},
+    {&tile_decode_8x8, 4096, {ROM_VID_6K, ROM_VID_6J, ROM_VID_6H, ROM_VID_6G},
+     4},
+};
+
+/* decoded tile roms, shared by all instances */
+static tile_rom_t tile_roms[TILE_ROM_COUNT];
+static uint8_t tile_roms_buffer[TILE_ROMS_SIZE];
+
+/* the decoding states of the tiles, when they are decoded on demand */
+static _Atomic uint8_t tile_states[1024 + 1024 + 1024 + 4096];
+static bool lazy_tiles = false;
+
+/* the packed sprite tiles, which have a nibble and a mask bit for each pixel,
+ * and their flags */
+static uint8_t sprite_tiles_packed[SPRITE_ROM_SIZE / 2 + SPRITE_ROM_SIZE / 8];
+static uint8_t sprite_tile_flags[4096];
+static bool packed_tiles = false;
+
+/* the sprite tiles in the three flipped orientations */
+static uint8_t sprite_tiles_flipped[SPRITE_ROM_SIZE * 3];
+static bool flipped_sprites = false;
+
+/* guards decoding the tile roms, which happens when the first instance is
+ * created */
+static pthread_mutex_t tile_roms_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool tile_roms_decoded = false;
 
 /**
  * Updates the color palette cache with 32-bit colors, this is called for CPU
@@ -206,9 +219,10 @@ static SDL_Texture *texture = NULL;
  * up to date, so that the 32-bit colors don't need to be computed for each
  * pixel in the video decoding code.
  */
-static inline void rygar_update_palette(uint16_t addr, uint8_t data) {
+static inline void rygar_update_palette(rygar_t *rygar, uint16_t addr,
+                                        uint8_t data) {
   uint16_t pal_index = addr >> 1;
-  uint32_t c = rygar.palette[pal_index];
+  uint32_t c = rygar->palette[pal_index];
 
   if (addr & 1) {
     /* odd addresses are the RRRRGGGG part */
@@ -221,87 +235,247 @@ static inline void rygar_update_palette(uint16_t addr, uint8_t data) {
     c = 0xff000000 | (c & 0x0000ffff) | b << 16;
   }
 
-  rygar.palette[pal_index] = c;
+  rygar->palette[pal_index] = c;
+  rygar->palette_dirty |= 1ULL << (pal_index >> 4);
+}
+
+/*
+ * Bus handlers for the pages which can't be accessed directly.
+ */
+
+static void rygar_write_char_ram(rygar_t *rygar, uint16_t addr,
+                                 uint8_t data) {
+  rygar->main.char_ram[addr - CHAR_RAM_START] = data;
+  tilemap_mark_tile_dirty(&rygar->char_tilemap,
+                          (addr - CHAR_RAM_START) & 0x3ff);
+}
+
+static void rygar_write_fg_ram(rygar_t *rygar, uint16_t addr, uint8_t data) {
+  rygar->main.fg_ram[addr - FG_RAM_START] = data;
+  tilemap_mark_tile_dirty(&rygar->fg_tilemap, (addr - FG_RAM_START) & 0x1ff);
+}
+
+static void rygar_write_bg_ram(rygar_t *rygar, uint16_t addr, uint8_t data) {
+  rygar->main.bg_ram[addr - BG_RAM_START] = data;
+  tilemap_mark_tile_dirty(&rygar->bg_tilemap, (addr - BG_RAM_START) & 0x1ff);
+}
+
+static void rygar_write_palette_ram(rygar_t *rygar, uint16_t addr,
+                                    uint8_t data) {
+  rygar->main.palette_ram[addr - PALETTE_RAM_START] = data;
+  rygar_update_palette(rygar, addr - PALETTE_RAM_START, data);
+}
+
+static uint8_t rygar_read_joystick(rygar_t *rygar, uint16_t addr) {
+  return rygar->main.joystick;
+}
+
+static uint8_t rygar_read_buttons(rygar_t *rygar, uint16_t addr) {
+  return rygar->main.buttons;
+}
+
+static uint8_t rygar_read_joystick2(rygar_t *rygar, uint16_t addr) {
+  return rygar->main.joystick2;
+}
+
+static uint8_t rygar_read_buttons2(rygar_t *rygar, uint16_t addr) {
+  return rygar->main.buttons2;
+}
+
+static uint8_t rygar_read_sys(rygar_t *rygar, uint16_t addr) {
+  return rygar->main.sys;
+}
+
+static uint8_t rygar_read_dip_sw2_h(rygar_t *rygar, uint16_t addr) {
+  return 0x8;
+}
+
+static void rygar_write_fg_scroll(rygar_t *rygar, uint16_t addr,
+                                  uint8_t data) {
+  uint8_t offset = addr - FG_SCROLL_START;
+  rygar->main.fg_scroll[offset] = data;
+  tilemap_set_scroll_x(
+      &rygar->fg_tilemap,
+      (rygar->main.fg_scroll[1] << 8 | rygar->main.fg_scroll[0]) +
+          SCROLL_OFFSET);
+  tilemap_set_scroll_y(&rygar->fg_tilemap, (rygar->main.fg_scroll[2]));
+}
+
+static void rygar_write_bg_scroll(rygar_t *rygar, uint16_t addr,
+                                  uint8_t data) {
+  uint8_t offset = addr - BG_SCROLL_START;
+  rygar->main.bg_scroll[offset] = data;
+  tilemap_set_scroll_x(
+      &rygar->bg_tilemap,
+      (rygar->main.bg_scroll[1] << 8 | rygar->main.bg_scroll[0]) +
+          SCROLL_OFFSET);
+  tilemap_set_scroll_y(&rygar->bg_tilemap, (rygar->main.bg_scroll[2]));
 }
 
 /**
- * This callback function is called for every CPU tick.
+ * Copies the direct host pointers for a range of pages from the memory map.
+ * This must be called whenever the memory map changes.
+ */
+static void rygar_update_pages(rygar_t *rygar, uint16_t addr, uint32_t size) {
+  for (uint32_t i = 0; i < size; i += MEM_PAGE_SIZE) {
+    int index = (addr + i) >> MEM_PAGE_SHIFT;
+    rygar->main.pages[index].read_ptr =
+        rygar->main.mem.page_table[index].read_ptr;
+    rygar->main.pages[index].write_ptr =
+        rygar->main.mem.page_table[index].write_ptr;
+  }
+}
+
+/**
+ * Maps the given bank of the banked ROM into the bank window.
+ */
+static void rygar_switch_bank(rygar_t *rygar, uint8_t bank) {
+  rygar->main.current_bank = bank;
+  mem_map_rom(&rygar->main.mem, BANK_LAYER, BANK_WINDOW_START,
+              BANK_WINDOW_SIZE,
+              rygar->main.banked_rom + bank * BANK_WINDOW_SIZE);
+  rygar_update_pages(rygar, BANK_WINDOW_START, BANK_WINDOW_SIZE);
+}
+
+static void rygar_write_bank_switch(rygar_t *rygar, uint16_t addr,
+                                    uint8_t data) {
+  /* bank addressed by DO3-DO6 in schematic */
+  rygar_switch_bank(rygar, (data >> 3) & 0x0f);
+}
+
+/* I/O register read handlers, the other registers read as zero */
+static const rygar_read_t io_read_table[IO_REGISTERS] = {
+    [JOYSTICK1 - IO_PAGE_START] = rygar_read_joystick,
+    [BUTTONS1 - IO_PAGE_START] = rygar_read_buttons,
+    [JOYSTICK2 - IO_PAGE_START] = rygar_read_joystick2,
+    [BUTTONS2 - IO_PAGE_START] = rygar_read_buttons2,
+    [SYS1 - IO_PAGE_START] = rygar_read_sys,
+    [DIP_SW2_H - IO_PAGE_START] = rygar_read_dip_sw2_h,
+};
+
+/* I/O register write handlers, the sound latch and flip screen registers
+ * aren't emulated */
+static const rygar_write_t io_write_table[IO_REGISTERS] = {
+    [FG_SCROLL_START - IO_PAGE_START] = rygar_write_fg_scroll,
+    [FG_SCROLL_START + 1 - IO_PAGE_START] = rygar_write_fg_scroll,
+    [FG_SCROLL_END - IO_PAGE_START] = rygar_write_fg_scroll,
+    [BG_SCROLL_START - IO_PAGE_START] = rygar_write_bg_scroll,
+    [BG_SCROLL_START + 1 - IO_PAGE_START] = rygar_write_bg_scroll,
+    [BG_SCROLL_END - IO_PAGE_START] = rygar_write_bg_scroll,
+    [BANK_SWITCH - IO_PAGE_START] = rygar_write_bank_switch,
+};
+
+static uint8_t rygar_read_io(rygar_t *rygar, uint16_t addr) {
+  uint16_t reg = addr - IO_PAGE_START;
+
+  if (reg < IO_REGISTERS && io_read_table[reg]) {
+    return io_read_table[reg](rygar, addr);
+  }
+
+  return 0;
+}
+
+static void rygar_write_io(rygar_t *rygar, uint16_t addr, uint8_t data) {
+  uint16_t reg = addr - IO_PAGE_START;
+
+  if (reg < IO_REGISTERS && io_write_table[reg]) {
+    io_write_table[reg](rygar, addr, data);
+  }
+}
+
+static uint8_t rygar_read_unmapped(rygar_t *rygar, uint16_t addr) { return 0; }
+
+static void rygar_write_unmapped(rygar_t *rygar, uint16_t addr, uint8_t data) {}
+
+/**
+ * Installs bus handlers for a range of pages in the main CPU address space. A
+ * NULL handler leaves the direct host pointer in place for that direction.
+ */
+static void rygar_map_handlers(rygar_t *rygar, uint16_t addr, uint32_t size,
+                               rygar_read_t read, rygar_write_t write) {
+  for (uint32_t i = 0; i < size; i += MEM_PAGE_SIZE) {
+    rygar_page_t *page = &rygar->main.pages[(addr + i) >> MEM_PAGE_SHIFT];
+
+    uint64_t bit = 1ULL << ((addr + i) >> MEM_PAGE_SHIFT);
+
+    if (read) {
+      page->read = read;
+      rygar->main.direct_read &= ~bit;
+    }
+
+    if (write) {
+      page->write = write;
+      rygar->main.direct_write &= ~bit;
+    }
+  }
+}
+
+/**
+ * Builds the page table for the main CPU bus.
+ *
+ * The direct host pointers are taken from the memory map, and the pages which
+ * need to be watched, or which don't contain plain memory, get handlers.
+ */
+static void rygar_init_pages(rygar_t *rygar) {
+  rygar_update_pages(rygar, 0, MEM_ADDR_RANGE);
+  rygar->main.direct_read = ~0ULL;
+  rygar->main.direct_write = ~0ULL;
+
+  rygar_map_handlers(rygar, CHAR_RAM_START, CHAR_RAM_SIZE, NULL,
+                     rygar_write_char_ram);
+  rygar_map_handlers(rygar, FG_RAM_START, FG_RAM_SIZE, NULL,
+                     rygar_write_fg_ram);
+  rygar_map_handlers(rygar, BG_RAM_START, BG_RAM_SIZE, NULL,
+                     rygar_write_bg_ram);
+  rygar_map_handlers(rygar, PALETTE_RAM_START, PALETTE_RAM_SIZE, NULL,
+                     rygar_write_palette_ram);
+  rygar_map_handlers(rygar, IO_PAGE_START, MEM_PAGE_SIZE, rygar_read_io,
+                     rygar_write_io);
+  rygar_map_handlers(rygar, IO_PAGE_START + MEM_PAGE_SIZE, MEM_PAGE_SIZE,
+                     rygar_read_unmapped, rygar_write_unmapped);
+}
+
+/**
+ * Handles a CPU write to the main board.
  */
-uint64_t rygar_tick_main(uint64_t pins) {
-  rygar.vsync_count--;
+static inline void rygar_mem_write(rygar_t *rygar, uint16_t addr,
+                                   uint8_t data) {
+  const rygar_page_t *page = &rygar->main.pages[addr >> MEM_PAGE_SHIFT];
 
-  if (rygar.vsync_count <= 0) {
-    rygar.vsync_count += VSYNC_PERIOD_4MHZ;
-    rygar.vblank_count = VBLANK_DURATION_4MHZ;
+  if (page->write) {
+    page->write(rygar, addr, data);
+  } else {
+    page->write_ptr[addr & MEM_PAGE_MASK] = data;
   }
+}
 
-  if (rygar.vblank_count > 0) {
-    rygar.vblank_count--;
-    pins |= Z80_INT; /* activate INT pin during VBLANK */
+/**
+ * Handles a CPU read from the main board.
+ */
+static inline uint8_t rygar_mem_read(rygar_t *rygar, uint16_t addr) {
+  const rygar_page_t *page = &rygar->main.pages[addr >> MEM_PAGE_SHIFT];
+
+  if (page->read) {
+    return page->read(rygar, addr);
   } else {
-    rygar.vblank_count = 0;
+    return page->read_ptr[addr & MEM_PAGE_MASK];
   }
+}
 
+/**
+ * This callback function is called for every CPU tick.
+ */
+uint64_t rygar_tick_main(rygar_t *rygar, uint64_t pins) {
   // tick the CPU
-  pins = z80_tick(&rygar.main.cpu, pins);
+  pins = z80_tick(&rygar->main.cpu, pins);
 
   uint16_t addr = Z80_GET_ADDR(pins);
 
   if (pins & Z80_MREQ) {
     if (pins & Z80_WR) {
-      uint8_t data = Z80_GET_DATA(pins);
-
-      if (BETWEEN(addr, RAM_START, RAM_END)) {
-        mem_wr(&rygar.main.mem, addr, data);
-
-        if (BETWEEN(addr, CHAR_RAM_START, CHAR_RAM_END)) {
-          tilemap_mark_tile_dirty(&rygar.char_tilemap,
-                                  (addr - CHAR_RAM_START) & 0x3ff);
-        } else if (BETWEEN(addr, FG_RAM_START, FG_RAM_END)) {
-          tilemap_mark_tile_dirty(&rygar.fg_tilemap,
-                                  (addr - FG_RAM_START) & 0x1ff);
-        } else if (BETWEEN(addr, BG_RAM_START, BG_RAM_END)) {
-          tilemap_mark_tile_dirty(&rygar.bg_tilemap,
-                                  (addr - BG_RAM_START) & 0x1ff);
-        } else if (BETWEEN(addr, PALETTE_RAM_START, PALETTE_RAM_END)) {
-          rygar_update_palette(addr - PALETTE_RAM_START, data);
-        }
-      } else if (BETWEEN(addr, FG_SCROLL_START, FG_SCROLL_END)) {
-        uint8_t offset = addr - FG_SCROLL_START;
-        rygar.main.fg_scroll[offset] = data;
-        tilemap_set_scroll_x(&rygar.fg_tilemap, (rygar.main.fg_scroll[1] << 8 |
-                                                 rygar.main.fg_scroll[0]) +
-                                                    SCROLL_OFFSET);
-        tilemap_set_scroll_y(&rygar.fg_tilemap, (rygar.main.fg_scroll[2]));
-      } else if (BETWEEN(addr, BG_SCROLL_START, BG_SCROLL_END)) {
-        uint8_t offset = addr - BG_SCROLL_START;
-        rygar.main.bg_scroll[offset] = data;
-        tilemap_set_scroll_x(&rygar.bg_tilemap, (rygar.main.bg_scroll[1] << 8 |
-                                                 rygar.main.bg_scroll[0]) +
-                                                    SCROLL_OFFSET);
-        tilemap_set_scroll_y(&rygar.bg_tilemap, (rygar.main.bg_scroll[2]));
-      } else if (addr == BANK_SWITCH) {
-        rygar.main.current_bank =
-            data >> 3; /* bank addressed by DO3-DO6 in schematic */
-      }
+      rygar_mem_write(rygar, addr, Z80_GET_DATA(pins));
     } else if (pins & Z80_RD) {
-      if (addr <= RAM_END) {
-        Z80_SET_DATA(pins, mem_rd(&rygar.main.mem, addr));
-      } else if (BETWEEN(addr, BANK_WINDOW_START, BANK_WINDOW_END)) {
-        uint16_t banked_addr = addr - BANK_WINDOW_START +
-                               (rygar.main.current_bank * BANK_WINDOW_SIZE);
-        Z80_SET_DATA(pins, rygar.main.banked_rom[banked_addr]);
-      } else if (addr == JOYSTICK1) {
-        Z80_SET_DATA(pins, rygar.main.joystick);
-      } else if (addr == BUTTONS1) {
-        Z80_SET_DATA(pins, rygar.main.buttons);
-      } else if (addr == SYS1) {
-        Z80_SET_DATA(pins, rygar.main.sys);
-      } else if (addr == DIP_SW2_H) {
-        Z80_SET_DATA(pins, 0x8);
-      } else {
-        Z80_SET_DATA(pins, 0);
-      }
+      Z80_SET_DATA(pins, rygar_mem_read(rygar, addr));
     }
   }
 
@@ -313,6 +487,75 @@ uint64_t rygar_tick_main(uint64_t pins) {
   return pins;
 }
 
+/*
+ * Bus callbacks for the instruction-stepped CPU core. The main board doesn't
+ * decode any I/O ports, so I/O reads return zero.
+ */
+
+static uint8_t rygar_bus_mem_read(void *user_data, uint16_t addr) {
+  return rygar_mem_read((rygar_t *)user_data, addr);
+}
+
+static void rygar_bus_mem_write(void *user_data, uint16_t addr,
+                                uint8_t data) {
+  rygar_mem_write((rygar_t *)user_data, addr, data);
+}
+
+static uint8_t rygar_bus_io_read(void *user_data, uint16_t port) { return 0; }
+
+static void rygar_bus_io_write(void *user_data, uint16_t port, uint8_t data) {}
+
+static uint8_t rygar_bus_int_ack(void *user_data) {
+  rygar_t *rygar = (rygar_t *)user_data;
+
+  /* clear interrupt */
+  rygar->main.pins &= ~Z80_INT;
+
+  return 0;
+}
+
+/*
+ * Bus callbacks used while the idle loop detector watches an iteration of a
+ * candidate loop. Any write, I/O access, or read from a page with a handler is
+ * a side effect which rules the loop out.
+ */
+
+static uint8_t rygar_probe_mem_read(void *user_data, uint16_t addr) {
+  rygar_t *rygar = (rygar_t *)user_data;
+
+  if (rygar->main.pages[addr >> MEM_PAGE_SHIFT].read) {
+    rygar->idle.dirty = true;
+  }
+
+  return rygar_mem_read(rygar, addr);
+}
+
+static void rygar_probe_mem_write(void *user_data, uint16_t addr,
+                                  uint8_t data) {
+  rygar_t *rygar = (rygar_t *)user_data;
+  rygar->idle.dirty = true;
+  rygar_mem_write(rygar, addr, data);
+}
+
+static uint8_t rygar_probe_io_read(void *user_data, uint16_t port) {
+  rygar_t *rygar = (rygar_t *)user_data;
+  rygar->idle.dirty = true;
+  return rygar_bus_io_read(user_data, port);
+}
+
+static void rygar_probe_io_write(void *user_data, uint16_t port,
+                                 uint8_t data) {
+  rygar_t *rygar = (rygar_t *)user_data;
+  rygar->idle.dirty = true;
+  rygar_bus_io_write(user_data, port, data);
+}
+
+static uint8_t rygar_probe_int_ack(void *user_data) {
+  rygar_t *rygar = (rygar_t *)user_data;
+  rygar->idle.dirty = true;
+  return rygar_bus_int_ack(user_data);
+}
+
 void char_tile_info(uint8_t *ram, tile_t *tile, int index) {
   uint8_t lo = ram[index];
   uint8_t hi = ram[index + 0x400];
@@ -350,356 +593,1240 @@ void bg_tile_info(uint8_t *ram, tile_t *tile, int index) {
 }
 
 /**
- * Decodes the tile ROMs.
+ * Decodes the first count tile ROMs one after the other to the buffer, with
+ * the given decoder.
  */
-void rygar_decode_tiles() {
-  uint8_t tmp[0x20000];
+static void rygar_decode_first_tile_roms(
+    uint8_t *dst, int count,
+    void (*decode)(const tile_decode_desc_t *, const uint8_t *, uint8_t *,
+                   int)) {
+  /* each ROM chip is decoded in turn, as the tiles never straddle two chips */
+  for (int i = 0; i < count; i++) {
+    const tile_decode_desc_t *desc = tile_rom_layouts[i].desc;
+    int bank_count = tile_rom_layouts[i].bank_count;
+    int tiles = tile_rom_layouts[i].count / bank_count;
+
+    for (int j = 0; j < bank_count; j++) {
+      decode(desc, roms[tile_rom_layouts[i].banks[j]], dst, tiles);
+      dst += tiles * desc->tile_width * desc->tile_height;
+    }
+  }
+}
 
-  /* decode descriptor for a 8x8 tile */
-  tile_decode_desc_t tile_decode_8x8 = {
-      .tile_width = 8,
-      .tile_height = 8,
-      .planes = 4,
-      .plane_offsets = {STEP4(0, 1)},
-      .x_offsets = {STEP8(0, 4)},
-      .y_offsets = {STEP8(0, 4 * 8)},
-      .tile_size = 4 * 8, /* 32 bytes */
-  };
+/**
+ * Decodes the tile ROMs, or copies the decoded tiles from a boot cache if
+ * cache isn't NULL.
+ *
+ * The decoded tile ROMs are never written to after they have been decoded, so
+ * they are shared by every machine instance in the process.
+ */
+static void rygar_decode_tiles(const uint8_t *cache) {
+#ifdef RYGAR_DECODED_TILES
+  /* the tiles decoded at build time are only valid for the built in ROMs */
+  const uint8_t *data = romset_loaded ? tile_roms_buffer : dump_tiles;
+#else
+  const uint8_t *data = tile_roms_buffer;
+#endif
+  _Atomic uint8_t *states = NULL;
+
+  /* the decoded tiles which are already at hand, or NULL if they are decoded
+   * to the buffer */
+  const uint8_t *tiles = data != tile_roms_buffer ? data : cache;
+
+  /* the 8-bit sprite tiles aren't kept when they are packed */
+  int count = packed_tiles ? SPRITE_TILES : TILE_ROM_COUNT;
+  size_t size = packed_tiles ? TILE_ROMS_SIZE - SPRITE_ROM_SIZE
+                             : TILE_ROMS_SIZE;
+
+  if (data != tile_roms_buffer) {
+    /* the tiles were decoded at build time */
+  } else if (cache) {
+    memcpy(tile_roms_buffer, cache, size);
+  } else if (lazy_tiles) {
+    states = tile_states;
+  } else {
+    rygar_decode_first_tile_roms(tile_roms_buffer, count, tile_decode);
+  }
 
-  /* decode descriptor for a 16x16 tile, made up of four 8x8 tiles */
-  tile_decode_desc_t tile_decode_16x16 = {
-      .tile_width = 16,
-      .tile_height = 16,
-      .planes = 4,
-      .plane_offsets = {STEP4(0, 1)},
-      .x_offsets = {STEP8(0, 4), STEP8(4 * 8 * 8, 4)},
-      .y_offsets = {STEP8(0, 4 * 8), STEP8(4 * 8 * 8 * 2, 4 * 8)},
-      .tile_size = 4 * 4 * 8, /* 128 bytes */
-  };
+  for (int i = 0; i < TILE_ROM_COUNT; i++) {
+    const tile_decode_desc_t *desc = tile_rom_layouts[i].desc;
+    tile_rom_t *rom = &tile_roms[i];
+
+    rom->data = data;
+    rom->count = tile_rom_layouts[i].count;
+    rom->tile_size = desc->tile_width * desc->tile_height;
+    rom->states = states;
+    rom->desc = desc;
+    rom->bank_size =
+        rom->count * desc->tile_size / tile_rom_layouts[i].bank_count;
+
+    for (int j = 0; j < tile_rom_layouts[i].bank_count; j++) {
+      rom->banks[j] = roms[tile_rom_layouts[i].banks[j]];
+    }
+
+    if (i == SPRITE_TILES) {
+      if (packed_tiles) {
+        rom->data = NULL;
+        rom->packed = sprite_tiles_packed;
+        rom->packed_size =
+            tile_packed_size(desc->tile_width, desc->tile_height);
+        rom->tile_flags = sprite_tile_flags;
+      }
+
+      if (flipped_sprites) {
+        rom->flipped = sprite_tiles_flipped;
+      }
+
+      /* the sprites are packed from the tiles at hand, or decoded again from
+       * the ROM chips */
+      if (!states) {
+        tile_rom_convert_all(rom, rom->data ? rom->data : tiles);
+      }
+    }
+
+    data += rom->count * rom->tile_size;
+
+    if (tiles) {
+      tiles += rom->count * rom->tile_size;
+    }
+
+    if (states) {
+      states += rom->count;
+    }
+  }
+}
 
-  /* char rom */
-  memcpy(&tmp[0x00000], dump_cpu_8k, 0x8000);
-
-  /* decode char rom */
-  tile_decode(&tile_decode_8x8, (uint8_t *)&tmp,
-              (uint8_t *)&rygar.main.char_rom, 1024);
-
-  tilemap_init(&rygar.char_tilemap, &(tilemap_desc_t){
-                                        .tile_cb = char_tile_info,
-                                        .ram = rygar.main.char_ram,
-                                        .rom = rygar.main.char_rom,
-                                        .tile_width = 8,
-                                        .tile_height = 8,
-                                        .cols = 32,
-                                        .rows = 32,
-                                    });
-
-  /* fg rom */
-  memcpy(&tmp[0x00000], dump_vid_6p, 0x8000);
-  memcpy(&tmp[0x08000], dump_vid_6o, 0x8000);
-  memcpy(&tmp[0x10000], dump_vid_6n, 0x8000);
-  memcpy(&tmp[0x18000], dump_vid_6l, 0x8000);
-
-  /* decode fg rom */
-  tile_decode(&tile_decode_16x16, (uint8_t *)&tmp,
-              (uint8_t *)&rygar.main.fg_rom, 1024);
-
-  tilemap_init(&rygar.fg_tilemap, &(tilemap_desc_t){
-                                      .tile_cb = fg_tile_info,
-                                      .ram = rygar.main.fg_ram,
-                                      .rom = rygar.main.fg_rom,
-                                      .tile_width = 16,
-                                      .tile_height = 16,
-                                      .cols = 32,
-                                      .rows = 16,
-                                  });
-
-  /* bg rom */
-  memcpy(&tmp[0x00000], dump_vid_6f, 0x8000);
-  memcpy(&tmp[0x08000], dump_vid_6e, 0x8000);
-  memcpy(&tmp[0x10000], dump_vid_6c, 0x8000);
-  memcpy(&tmp[0x18000], dump_vid_6b, 0x8000);
-
-  /* decode bg rom */
-  tile_decode(&tile_decode_16x16, (uint8_t *)&tmp,
-              (uint8_t *)&rygar.main.bg_rom, 1024);
-
-  tilemap_init(&rygar.bg_tilemap, &(tilemap_desc_t){
-                                      .tile_cb = bg_tile_info,
-                                      .ram = rygar.main.bg_ram,
-                                      .rom = rygar.main.bg_rom,
-                                      .tile_width = 16,
-                                      .tile_height = 16,
-                                      .cols = 32,
-                                      .rows = 16,
-                                  });
-
-  /* sprite rom */
-  memcpy(&tmp[0x00000], dump_vid_6k, 0x8000);
-  memcpy(&tmp[0x08000], dump_vid_6j, 0x8000);
-  memcpy(&tmp[0x10000], dump_vid_6h, 0x8000);
-  memcpy(&tmp[0x18000], dump_vid_6g, 0x8000);
-
-  /* decode sprite rom */
-  tile_decode(&tile_decode_8x8, (uint8_t *)&tmp,
-              (uint8_t *)&rygar.main.sprite_rom, 4096);
-}
-
-/**
- * Initialises the Rygar arcade hardware.
- */
-void rygar_init() {
-  memset(&rygar, 0, sizeof(rygar_t));
-
-  rygar.vsync_count = VSYNC_PERIOD_4MHZ;
-  rygar.vblank_count = 0;
-
-  z80_init(&rygar.main.cpu);
-  mem_init(&rygar.main.mem);
-  bitmap_init(&rygar.bitmap, BUFFER_WIDTH, BUFFER_HEIGHT);
+void rygar_set_lazy_tiles(bool enabled) { lazy_tiles = enabled; }
+
+void rygar_set_packed_tiles(bool enabled) { packed_tiles = enabled; }
+
+void rygar_set_flipped_sprites(bool enabled) { flipped_sprites = enabled; }
+
+bool rygar_load_roms(const char *path, const char **error) {
+  if (!romset_load(&romset, path, rom_files, ROM_COUNT)) {
+    *error = romset.error;
+    return false;
+  }
+
+  for (int i = 0; i < ROM_COUNT; i++) {
+    roms[i] = romset.data[i];
+  }
+
+  romset_loaded = true;
+
+  return true;
+}
+
+void rygar_decode_tile_roms(uint8_t *dst, bool generic) {
+  rygar_decode_first_tile_roms(dst, TILE_ROM_COUNT,
+                               generic ? tile_decode_generic : tile_decode);
+}
+
+/**
+ * Initialises the Rygar arcade hardware. The tile roms are copied from the
+ * decoded tiles, unless they are NULL or the tile roms have already been
+ * decoded by another instance.
+ */
+static void rygar_init_with_tiles(rygar_t *rygar, const uint8_t *tiles) {
+  memset(rygar, 0, sizeof(rygar_t));
+
+  /* the tile roms only need to be decoded once */
+  pthread_mutex_lock(&tile_roms_lock);
+
+  if (!tile_roms_decoded) {
+    rygar_decode_tiles(tiles);
+    tile_roms_decoded = true;
+  }
+
+  pthread_mutex_unlock(&tile_roms_lock);
+
+  /* idle loops are skipped by the instruction-stepped cores */
+  rygar->idle_skip = true;
+
+  /* the frame buffer rows are packed by default */
+  rygar->pitch = SCREEN_WIDTH * sizeof(uint32_t);
+
+  /* the first VBLANK starts on the last tick of the first frame */
+  sched_init(&rygar->sched);
+  sched_add(&rygar->sched, EVENT_VBLANK_START, VSYNC_PERIOD_4MHZ - 1);
+
+  z80_init(&rygar->main.cpu);
+  mem_init(&rygar->main.mem);
+  bitmap_init(&rygar->bitmap, BUFFER_WIDTH, BUFFER_HEIGHT);
 
   /* main memory */
-  mem_map_rom(&rygar.main.mem, 0, 0x0000, 0x8000, dump_5);
-  mem_map_rom(&rygar.main.mem, 0, 0x8000, 0x4000, dump_cpu_5m);
-  mem_map_ram(&rygar.main.mem, 0, WORK_RAM_START, WORK_RAM_SIZE,
-              rygar.main.work_ram);
-  mem_map_ram(&rygar.main.mem, 0, CHAR_RAM_START, CHAR_RAM_SIZE,
-              rygar.main.char_ram);
-  mem_map_ram(&rygar.main.mem, 0, FG_RAM_START, FG_RAM_SIZE, rygar.main.fg_ram);
-  mem_map_ram(&rygar.main.mem, 0, BG_RAM_START, BG_RAM_SIZE, rygar.main.bg_ram);
-  mem_map_ram(&rygar.main.mem, 0, SPRITE_RAM_START, SPRITE_RAM_SIZE,
-              rygar.main.sprite_ram);
-  mem_map_ram(&rygar.main.mem, 0, PALETTE_RAM_START, PALETTE_RAM_SIZE,
-              rygar.main.palette_ram);
+  mem_map_rom(&rygar->main.mem, 0, 0x0000, 0x8000, roms[ROM_5P]);
+  mem_map_rom(&rygar->main.mem, 0, 0x8000, 0x4000, roms[ROM_CPU_5M]);
+  mem_map_ram(&rygar->main.mem, 0, WORK_RAM_START, WORK_RAM_SIZE,
+              rygar->main.work_ram);
+  mem_map_ram(&rygar->main.mem, 0, CHAR_RAM_START, CHAR_RAM_SIZE,
+              rygar->main.char_ram);
+  mem_map_ram(&rygar->main.mem, 0, FG_RAM_START, FG_RAM_SIZE,
+              rygar->main.fg_ram);
+  mem_map_ram(&rygar->main.mem, 0, BG_RAM_START, BG_RAM_SIZE,
+              rygar->main.bg_ram);
+  mem_map_ram(&rygar->main.mem, 0, SPRITE_RAM_START, SPRITE_RAM_SIZE,
+              rygar->main.sprite_ram);
+  mem_map_ram(&rygar->main.mem, 0, PALETTE_RAM_START, PALETTE_RAM_SIZE,
+              rygar->main.palette_ram);
 
   /* banked rom */
-  memcpy(&rygar.main.banked_rom[0x00000], dump_cpu_5j, 0x8000);
+  rygar->main.banked_rom = roms[ROM_CPU_5J];
+  mem_map_rom(&rygar->main.mem, BANK_LAYER, BANK_WINDOW_START,
+              BANK_WINDOW_SIZE, rygar->main.banked_rom);
 
-  rygar_decode_tiles();
+  /* main CPU bus */
+  rygar_init_pages(rygar);
+
+  /* tile roms */
+  rygar->main.char_rom = &tile_roms[CHAR_TILES];
+  rygar->main.fg_rom = &tile_roms[FG_TILES];
+  rygar->main.bg_rom = &tile_roms[BG_TILES];
+  rygar->main.sprite_rom = &tile_roms[SPRITE_TILES];
+
+  tilemap_init(&rygar->char_tilemap, &(tilemap_desc_t){
+                                         .tile_cb = char_tile_info,
+                                         .ram = rygar->main.char_ram,
+                                         .rom = rygar->main.char_rom,
+                                         .tile_width = 8,
+                                         .tile_height = 8,
+                                         .cols = 32,
+                                         .rows = 32,
+                                     });
+
+  tilemap_init(&rygar->fg_tilemap, &(tilemap_desc_t){
+                                       .tile_cb = fg_tile_info,
+                                       .ram = rygar->main.fg_ram,
+                                       .rom = rygar->main.fg_rom,
+                                       .tile_width = 16,
+                                       .tile_height = 16,
+                                       .cols = 32,
+                                       .rows = 16,
+                                   });
+
+  tilemap_init(&rygar->bg_tilemap, &(tilemap_desc_t){
+                                       .tile_cb = bg_tile_info,
+                                       .ram = rygar->main.bg_ram,
+                                       .rom = rygar->main.bg_rom,
+                                       .tile_width = 16,
+                                       .tile_height = 16,
+                                       .cols = 32,
+                                       .rows = 16,
+                                   });
 }
 
-void rygar_shutdown() {
-  bitmap_shutdown(&rygar.bitmap);
-  tilemap_shutdown(&rygar.char_tilemap);
-  tilemap_shutdown(&rygar.fg_tilemap);
-  tilemap_shutdown(&rygar.bg_tilemap);
+void rygar_shutdown(rygar_t *rygar) {
+  free(rygar->run_ahead_state);
+  bitmap_shutdown(&rygar->bitmap);
+  tilemap_shutdown(&rygar->char_tilemap);
+  tilemap_shutdown(&rygar->fg_tilemap);
+  tilemap_shutdown(&rygar->bg_tilemap);
 }
 
+void rygar_init(rygar_t *rygar) { rygar_init_with_tiles(rygar, NULL); }
+
 /**
- * Applies the palette to the source bitmap data.
+ * Allocates a new machine instance like rygar_create, with the tile roms
+ * copied from the given decoded tiles if they haven't been decoded yet.
  */
-void apply_palette(uint16_t *src, uint32_t *dest, int width, int height) {
-  for (int i = 0; i < width * height; i++) {
-    dest[i] = rygar.palette[src[i]];
+static rygar_t *rygar_create_with_tiles(const uint8_t *tiles) {
+  rygar_t *rygar = (rygar_t *)malloc(sizeof(rygar_t));
+
+  if (rygar) {
+    rygar_init_with_tiles(rygar, tiles);
   }
+
+  return rygar;
 }
 
-void capture_bitmap(bitmap_t *bitmap, char const *filename) {
-  uint32_t buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+rygar_t *rygar_create() { return rygar_create_with_tiles(NULL); }
 
-  /* skip the first 16 lines */
-  uint16_t *data = bitmap_data(bitmap, 0, 16);
+void rygar_destroy(rygar_t *rygar) {
+  if (rygar) {
+    rygar_shutdown(rygar);
+    free(rygar);
+  }
+}
+
+/**
+ * Copies the visible part of the bitmap to the 32-bit frame buffer, skipping
+ * the first 16 lines.
+ */
+static void rygar_copy_frame(rygar_t *rygar, const bitmap_t *bitmap,
+                             uint32_t *buffer, int pitch) {
+  if (bitmap->rgba) {
+    bitmap_read_rgba(bitmap, 16, SCREEN_HEIGHT, buffer, pitch);
+  } else {
+    bitmap_apply_palette(bitmap, 16, SCREEN_HEIGHT, rygar->palette, buffer,
+                         pitch);
+  }
+}
 
-  /* copy the bitmap data to the output buffer */
-  apply_palette(data, buffer, SCREEN_WIDTH, SCREEN_HEIGHT);
+void capture_bitmap(rygar_t *rygar, bitmap_t *bitmap, char const *filename) {
+  uint32_t buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+  rygar_copy_frame(rygar, bitmap, buffer, SCREEN_WIDTH * 4);
 
   /* write the snapshot */
   stbi_write_png(filename, SCREEN_WIDTH, SCREEN_HEIGHT, 4, buffer,
                  SCREEN_WIDTH * 4);
 }
 
+void rygar_set_rgba(rygar_t *rygar, bool enabled) {
+  const uint32_t *palette = enabled ? rygar->palette : NULL;
+
+  bitmap_shutdown(&rygar->bitmap);
+
+  if (enabled) {
+    bitmap_init_rgba(&rygar->bitmap, BUFFER_WIDTH, BUFFER_HEIGHT, palette);
+  } else {
+    bitmap_init(&rygar->bitmap, BUFFER_WIDTH, BUFFER_HEIGHT);
+  }
+
+  tilemap_set_palette(&rygar->char_tilemap, palette);
+  tilemap_set_palette(&rygar->fg_tilemap, palette);
+  tilemap_set_palette(&rygar->bg_tilemap, palette);
+
+  rygar->rgba = enabled;
+  rygar->palette_dirty = 0;
+}
+
+/**
+ * Marks the tiles which use the colors that have changed in the palette as
+ * dirty, so their 32-bit colors are resolved again.
+ */
+static void rygar_invalidate_palette(rygar_t *rygar) {
+  uint64_t dirty = rygar->palette_dirty;
+
+  if (rygar->rgba && dirty) {
+    tilemap_mark_colors_dirty(&rygar->char_tilemap, (uint16_t)(dirty >> 16));
+    tilemap_mark_colors_dirty(&rygar->fg_tilemap, (uint16_t)(dirty >> 32));
+    tilemap_mark_colors_dirty(&rygar->bg_tilemap, (uint16_t)(dirty >> 48));
+  }
+
+  rygar->palette_dirty = 0;
+}
+
 /**
  * Draws the graphics layers to the frame buffer.
  */
-void rygar_draw(uint32_t *buffer) {
-  bitmap_t *bitmap = &rygar.bitmap;
+void rygar_draw(rygar_t *rygar, uint32_t *buffer) {
+  bitmap_t *bitmap = &rygar->bitmap;
+
+  rygar_invalidate_palette(rygar);
 
   /* fill bitmap with the background color */
   bitmap_fill(bitmap, 0x100);
 
   /* draw layers */
-  tilemap_draw(&rygar.bg_tilemap, bitmap, 0x300, TILE_LAYER3);
-  tilemap_draw(&rygar.fg_tilemap, bitmap, 0x200, TILE_LAYER2);
-  tilemap_draw(&rygar.char_tilemap, bitmap, 0x100, TILE_LAYER1);
-  sprite_draw(bitmap, (uint8_t *)&rygar.main.sprite_ram,
-              (uint8_t *)&rygar.main.sprite_rom, 0, TILE_LAYER0);
+  tilemap_draw(&rygar->bg_tilemap, bitmap, 0x300, TILE_LAYER3);
+  tilemap_draw(&rygar->fg_tilemap, bitmap, 0x200, TILE_LAYER2);
+  tilemap_draw(&rygar->char_tilemap, bitmap, 0x100, TILE_LAYER1);
+  sprite_draw(bitmap, rygar->main.sprite_ram, rygar->main.sprite_rom, 0,
+              TILE_LAYER0);
 
-  /* skip the first 16 lines */
-  uint16_t *data = bitmap_data(bitmap, 0, 16);
+  rygar_copy_frame(rygar, bitmap, buffer, rygar->pitch);
 
-  /* copy bitmap to 32-bit frame buffer */
-  apply_palette(data, buffer, SCREEN_WIDTH, SCREEN_HEIGHT);
-
-  if (rygar.capture) {
+  if (rygar->capture) {
     printf("capturing...\n");
 
     bitmap_fill(bitmap, 0);
-    sprite_draw(bitmap, (uint8_t *)&rygar.main.sprite_ram,
-                (uint8_t *)&rygar.main.sprite_rom, 0, TILE_LAYER0);
-    capture_bitmap(bitmap, "sprite.png");
+    sprite_draw(bitmap, rygar->main.sprite_ram, rygar->main.sprite_rom, 0,
+                TILE_LAYER0);
+    capture_bitmap(rygar, bitmap, "sprite.png");
 
     bitmap_fill(bitmap, 0);
-    tilemap_draw(&rygar.char_tilemap, bitmap, 0x100, TILE_LAYER1);
-    capture_bitmap(bitmap, "char.png");
+    tilemap_draw(&rygar->char_tilemap, bitmap, 0x100, TILE_LAYER1);
+    capture_bitmap(rygar, bitmap, "char.png");
 
     bitmap_fill(bitmap, 0);
-    tilemap_draw(&rygar.fg_tilemap, bitmap, 0x200, TILE_LAYER2);
-    capture_bitmap(bitmap, "foreground.png");
+    tilemap_draw(&rygar->fg_tilemap, bitmap, 0x200, TILE_LAYER2);
+    capture_bitmap(rygar, bitmap, "foreground.png");
 
     bitmap_fill(bitmap, 0);
-    tilemap_draw(&rygar.bg_tilemap, bitmap, 0x300, TILE_LAYER3);
-    capture_bitmap(bitmap, "background.png");
+    tilemap_draw(&rygar->bg_tilemap, bitmap, 0x300, TILE_LAYER3);
+    capture_bitmap(rygar, bitmap, "background.png");
+
+    rygar->capture = false;
+  }
+}
 
-    rygar.capture = false;
+/**
+ * Handles a timed event from the scheduler.
+ *
+ * The following events are scheduled relative to the time the event was due,
+ * rather than the current time, so that they don't drift when the CPU overruns
+ * an event.
+ */
+static void rygar_event(rygar_t *rygar, int type, uint64_t time) {
+  sched_t *sched = &rygar->sched;
+
+  switch (type) {
+  case EVENT_VBLANK_START:
+    rygar->vblank = true;
+    rygar->skipped_ticks = rygar->idle.skipped;
+    rygar->idle.skipped = 0;
+    sched_add(sched, EVENT_VBLANK_END, time + VBLANK_DURATION_4MHZ);
+    sched_add(sched, EVENT_VBLANK_START, time + VSYNC_PERIOD_4MHZ);
+    break;
+  case EVENT_VBLANK_END:
+    rygar->vblank = false;
+    break;
   }
 }
 
 /**
- * Runs the emulation for one frame.
+ * Runs the cycle-stepped CPU core until the given tick.
  */
-void rygar_exec(uint32_t delta, uint32_t *buffer) {
-  uint32_t ticks_to_run = clk_us_to_ticks(CPU_FREQ, delta * 1000);
-  uint64_t pins = rygar.main.pins;
+static void rygar_run_cycles(rygar_t *rygar, uint64_t until, uint64_t irq) {
+  sched_t *sched = &rygar->sched;
+  uint64_t pins = rygar->main.pins;
 
-  for (uint32_t tick = 0; tick < ticks_to_run; tick++) {
-    pins = rygar_tick_main(pins);
+  for (; sched->now < until; sched->now++) {
+    pins = rygar_tick_main(rygar, pins | irq);
   }
 
-  rygar.main.pins = pins;
+  rygar->main.pins = pins;
+}
+
+/**
+ * Returns true if the CPU is in the same state as the snapshot, ignoring the
+ * refresh register.
+ */
+static bool rygar_idle_same_state(const z80_t *a, const z80_t *b) {
+  return a->pc == b->pc && a->af == b->af && a->bc == b->bc &&
+         a->de == b->de && a->hl == b->hl && a->ix == b->ix &&
+         a->iy == b->iy && a->sp == b->sp && a->wz == b->wz &&
+         a->i == b->i && a->im == b->im && a->iff1 == b->iff1 &&
+         a->iff2 == b->iff2 && a->af2 == b->af2 && a->bc2 == b->bc2 &&
+         a->de2 == b->de2 && a->hl2 == b->hl2 &&
+         (a->pins & Z80_STEP_EI) == (b->pins & Z80_STEP_EI);
+}
 
-  rygar_draw(buffer);
+/**
+ * Fast-forwards the CPU by the given number of iterations of an idle loop,
+ * which take the given number of ticks and opcode fetches each.
+ */
+static void rygar_idle_skip(rygar_t *rygar, uint64_t count, uint64_t ticks,
+                            uint8_t fetches) {
+  z80_t *cpu = &rygar->main.cpu;
+  uint64_t skipped = count * ticks;
+
+  cpu->r = (cpu->r & 0x80) | ((cpu->r + count * fetches) & 0x7f);
+  rygar->sched.now += skipped;
+  rygar->idle.skipped += skipped;
 }
 
-/* This function runs once at startup. */
-SDL_AppResult SDL_AppInit(void **appstate, int argc, char *argv[]) {
-  if (!SDL_CreateWindowAndRenderer("Hello World", WIDTH, HEIGHT,
-                                   SDL_WINDOW_RESIZABLE, &window, &renderer)) {
-    SDL_Log("Couldn't create window/renderer: %s", SDL_GetError());
-    return SDL_APP_FAILURE;
+/**
+ * Looks for the CPU spinning in an idle loop after an instruction has been
+ * executed, and fast-forwards it as close to the given tick as possible.
+ *
+ * Idle loops are found by watching a single iteration of a short backward
+ * branch. If the iteration ends in exactly the same CPU state, without any
+ * side effects, then every following iteration will be the same, until an
+ * interrupt changes something. A HALT instruction is a special case of such a
+ * loop.
+ *
+ * The iterations are skipped whole, so the CPU reaches the same instruction
+ * boundaries as it would have done by executing them, and the cycles are
+ * accounted for exactly.
+ */
+static void rygar_idle_detect(rygar_t *rygar, uint16_t pc, uint64_t until) {
+  z80_t *cpu = &rygar->main.cpu;
+  idle_t *idle = &rygar->idle;
+  uint64_t now = rygar->sched.now;
+
+  /* a pending interrupt will break out of the loop */
+  if (rygar->main.pins & Z80_INT) {
+    idle->probing = false;
+    return;
   }
 
-  if (!SDL_SetWindowAspectRatio(window, 1.33, 1.33)) {
-    SDL_Log("Couldn't set aspect ratio: %s", SDL_GetError());
-    return SDL_APP_FAILURE;
+  if (cpu->pins & Z80_STEP_HALT) {
+    /* the halted CPU executes a NOP every 4 ticks */
+    if (now <= until) {
+      rygar_idle_skip(rygar, (until - now) / 4 + 1, 4, 1);
+    }
+    return;
   }
 
-  texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_XBGR8888,
-                              SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH,
-                              SCREEN_HEIGHT);
+  if (idle->probing && now - idle->time > IDLE_PROBE_TICKS) {
+    idle->probing = false;
+  }
 
-  if (!texture) {
-    SDL_Log("Couldn't create streaming texture: %s", SDL_GetError());
-    return SDL_APP_FAILURE;
+  /* only short backward branches are candidates */
+  if (cpu->pc >= pc || pc - cpu->pc > IDLE_LOOP_SIZE) {
+    return;
   }
 
-  rygar_init();
+  if (idle->probing && idle->cpu.pc == cpu->pc) {
+    idle->probing = false;
+
+    if (!idle->dirty && rygar_idle_same_state(cpu, &idle->cpu) &&
+        now <= until) {
+      uint64_t ticks = now - idle->time;
+      uint8_t fetches = (cpu->r - idle->cpu.r) & 0x7f;
+      rygar_idle_skip(rygar, (until - now) / ticks, ticks, fetches);
+    }
 
-  return SDL_APP_CONTINUE;
+    return;
+  }
+
+  /* watch the next iteration */
+  idle->probing = true;
+  idle->dirty = false;
+  idle->cpu = *cpu;
+  idle->time = now;
 }
 
-/* This function runs when a new event (mouse input, keypresses, etc) occurs. */
-SDL_AppResult SDL_AppEvent(void *appstate, SDL_Event *event) {
-  switch (event->type) {
-  case SDL_EVENT_QUIT:
-    return SDL_APP_SUCCESS;
-  case SDL_EVENT_KEY_DOWN:
-    switch (event->key.scancode) {
-    case SDL_SCANCODE_LEFT:
-      rygar.main.joystick |= (1 << 0);
-      break;
-    case SDL_SCANCODE_RIGHT:
-      rygar.main.joystick |= (1 << 1);
-      break;
-    case SDL_SCANCODE_DOWN:
-      rygar.main.joystick |= (1 << 2);
-      break;
-    case SDL_SCANCODE_UP:
-      rygar.main.joystick |= (1 << 3);
-      break;
-    case SDL_SCANCODE_Z:
-      rygar.main.buttons |= (1 << 0);
-      break; /* attack */
-    case SDL_SCANCODE_X:
-      rygar.main.buttons |= (1 << 1);
-      break; /* jump */
-    case SDL_SCANCODE_5:
-      rygar.main.sys |= (1 << 2);
-      break; /* player 1 coin */
-    case SDL_SCANCODE_1:
-      rygar.main.sys |= (1 << 1);
-      break; /* player 1 start */
-    case SDL_SCANCODE_P:
-      rygar.capture = true;
-      break; /* capture */
-    default:
-      break;
+/**
+ * Runs the instruction-stepped CPU core until the given tick.
+ *
+ * Whole instructions are executed, so the CPU may overrun the given tick by a
+ * few cycles. The overrun is carried over, and the following events are fired
+ * late by the same amount.
+ */
+static void rygar_run_instructions(rygar_t *rygar, uint64_t until,
+                                   uint64_t irq) {
+  sched_t *sched = &rygar->sched;
+  z80_bus_t bus = {
+      .mem_read = rygar_bus_mem_read,
+      .mem_write = rygar_bus_mem_write,
+      .io_read = rygar_bus_io_read,
+      .io_write = rygar_bus_io_write,
+      .int_ack = rygar_bus_int_ack,
+      .user_data = rygar,
+  };
+
+  z80_bus_t probe_bus = {
+      .mem_read = rygar_probe_mem_read,
+      .mem_write = rygar_probe_mem_write,
+      .io_read = rygar_probe_io_read,
+      .io_write = rygar_probe_io_write,
+      .int_ack = rygar_probe_int_ack,
+      .user_data = rygar,
+  };
+
+  /* plain memory pages skip the bus callbacks in direct mode */
+  if (rygar->cpu_mode == RYGAR_CPU_DIRECT) {
+    bus.mem = &rygar->main.mem;
+    bus.direct_read = rygar->main.direct_read;
+    bus.direct_write = rygar->main.direct_write;
+  }
+
+  while (sched->now <= until) {
+    z80_t *cpu = &rygar->main.cpu;
+    uint16_t pc = cpu->pc;
+
+    /* the INT pin stays active until the interrupt is acknowledged */
+    rygar->main.pins |= irq;
+    sched->now += z80_step(cpu, rygar->idle.probing ? &probe_bus : &bus,
+                           rygar->main.pins);
+
+    if (rygar->idle_skip) {
+      rygar_idle_detect(rygar, pc, until);
     }
-    break;
+  }
+}
+
+/**
+ * Runs the CPU for the given number of ticks.
+ *
+ * The CPU runs uninterrupted until the next scheduled event, then the events
+ * which are due are fired.
+ *
+ * The run ends relative to where the previous run was due to end, so that any
+ * cycles overrun by the instruction-stepped core are made up for.
+ */
+void rygar_run(rygar_t *rygar, uint32_t ticks) {
+  sched_t *sched = &rygar->sched;
+  uint64_t end = rygar->run_end + ticks;
+
+  rygar->run_end = end;
 
-  case SDL_EVENT_KEY_UP:
-    switch (event->key.scancode) {
-    case SDL_SCANCODE_LEFT:
-      rygar.main.joystick &= ~(1 << 0);
-      break;
-    case SDL_SCANCODE_RIGHT:
-      rygar.main.joystick &= ~(1 << 1);
-      break;
-    case SDL_SCANCODE_DOWN:
-      rygar.main.joystick &= ~(1 << 2);
-      break;
-    case SDL_SCANCODE_UP:
-      rygar.main.joystick &= ~(1 << 3);
-      break;
-    case SDL_SCANCODE_Z:
-      rygar.main.buttons &= ~(1 << 0);
-      break; /* attack */
-    case SDL_SCANCODE_X:
-      rygar.main.buttons &= ~(1 << 1);
-      break; /* jump */
-    case SDL_SCANCODE_5:
-      rygar.main.sys &= ~(1 << 2);
-      break; /* player 1 coin */
-    case SDL_SCANCODE_1:
-      rygar.main.sys &= ~(1 << 1);
-      break; /* player 1 start */
-    default:
-      break;
+  while (sched->now < end) {
+    uint64_t time;
+
+    while ((time = sched_next(sched)) <= sched->now) {
+      rygar_event(rygar, sched_pop(sched), time);
     }
-    break;
 
-  default:
-    break;
+    uint64_t until = sched_next(sched);
+
+    if (until > end) {
+      until = end;
+    }
+
+    /* activate INT pin during VBLANK */
+    uint64_t irq = rygar->vblank ? Z80_INT : 0;
+
+    if (rygar->cpu_mode == RYGAR_CPU_CYCLE) {
+      rygar_run_cycles(rygar, until, irq);
+    } else {
+      rygar_run_instructions(rygar, until, irq);
+    }
+  }
+}
+
+/**
+ * Switches between the cycle-stepped and instruction-stepped CPU cores.
+ *
+ * Both cores share the same CPU state, but the cycle-stepped core can be
+ * stopped in the middle of an instruction. It is run to the next instruction
+ * boundary before switching over.
+ */
+void rygar_set_cpu_mode(rygar_t *rygar, rygar_cpu_mode_t mode) {
+  z80_t *cpu = &rygar->main.cpu;
+  uint64_t pins = rygar->main.pins;
+
+  if (mode == rygar->cpu_mode) {
+    return;
+  }
+
+  /* the instruction-stepped modes only differ in how memory is accessed */
+  if (mode != RYGAR_CPU_CYCLE && rygar->cpu_mode != RYGAR_CPU_CYCLE) {
+    rygar->cpu_mode = mode;
+    return;
+  }
+
+  if (mode != RYGAR_CPU_CYCLE) {
+    while (!z80_opdone(cpu)) {
+      pins = rygar_tick_main(rygar, pins);
+      rygar->sched.now++;
+    }
+
+    /* the opcode fetch for the next instruction has already started, so its
+     * first tick is rewound to be counted again with the whole instruction */
+    cpu->pc--;
+    rygar->sched.now--;
+    cpu->pins &= Z80_HALT;
+    rygar->main.pins = pins & Z80_INT;
+  } else {
+    rygar->main.pins = z80_prefetch(cpu, cpu->pc) | (pins & Z80_INT);
+  }
+
+  rygar->cpu_mode = mode;
+}
+
+void rygar_set_pitch(rygar_t *rygar, int pitch) { rygar->pitch = pitch; }
+
+void rygar_set_idle_skip(rygar_t *rygar, bool enabled) {
+  rygar->idle_skip = enabled;
+  rygar->idle.probing = false;
+}
+
+/**
+ * Runs the emulation up to the next frame boundary, and draws the frame.
+ *
+ * The boundaries are multiples of the VSYNC period on the emulated clock, so
+ * every frame covers exactly the same ticks, however long the host takes to
+ * run it.
+ */
+void rygar_run_frame(rygar_t *rygar, uint32_t *buffer) {
+  uint64_t end = (rygar->run_end / VSYNC_PERIOD_4MHZ + 1) * VSYNC_PERIOD_4MHZ;
+
+  rygar_run(rygar, end - rygar->run_end);
+  rygar->frame++;
+
+  if (buffer) {
+    rygar_draw(rygar, buffer);
+  }
+}
+
+bool rygar_movie_frame(rygar_t *rygar, movie_t *movie) {
+  uint8_t inputs[MOVIE_INPUTS] = {rygar->main.joystick, rygar->main.buttons,
+                                  rygar->main.sys, rygar->main.joystick2,
+                                  rygar->main.buttons2};
+
+  if (!movie_frame(movie, inputs)) {
+    return false;
+  }
+
+  rygar->main.joystick = inputs[0];
+  rygar->main.buttons = inputs[1];
+  rygar->main.sys = inputs[2];
+  rygar->main.joystick2 = inputs[3];
+  rygar->main.buttons2 = inputs[4];
+
+  return true;
+}
+
+/**
+ * Runs a frame, then runs ahead of it to draw a later frame.
+ *
+ * The whole state is saved, rather than only the core state, because drawing
+ * the frame ahead updates the cached tilemaps. Restoring them along with the
+ * RAM saves having to redraw every tile on the next frame.
+ */
+void rygar_run_ahead(rygar_t *rygar, int frames, uint32_t *buffer) {
+  if (frames <= 0 || !buffer) {
+    rygar_run_frame(rygar, buffer);
+    return;
+  }
+
+  rygar_run_frame(rygar, NULL);
+
+  if (!rygar->run_ahead_state) {
+    rygar->run_ahead_size = rygar_save_state(rygar, NULL, 0);
+    rygar->run_ahead_state = (uint8_t *)malloc(rygar->run_ahead_size);
+
+    if (!rygar->run_ahead_state) {
+      rygar_draw(rygar, buffer);
+      return;
+    }
+  }
+
+  rygar_save_state(rygar, rygar->run_ahead_state, rygar->run_ahead_size);
+
+  for (int i = 1; i < frames; i++) {
+    rygar_run_frame(rygar, NULL);
+  }
+
+  rygar_run_frame(rygar, buffer);
+  rygar_load_state(rygar, rygar->run_ahead_state, rygar->run_ahead_size);
+}
+
+/**
+ * Returns the size of the saved state of a tilemap.
+ */
+static size_t rygar_tilemap_state_size(const tilemap_t *tilemap) {
+  size_t pixels = tilemap->bitmap.width * tilemap->bitmap.height;
+
+  return sizeof(tilemap->tiles) + 2 * sizeof(int) +
+         pixels * (sizeof(uint16_t) + sizeof(uint8_t));
+}
+
+static void rygar_save_tilemap(state_writer_t *writer, const char *tag,
+                               const tilemap_t *tilemap) {
+  size_t pixels = tilemap->bitmap.width * tilemap->bitmap.height;
+
+  state_begin_section(writer, tag);
+  state_write(writer, tilemap->tiles, sizeof(tilemap->tiles));
+  state_write(writer, &tilemap->scroll_x, sizeof(int));
+  state_write(writer, &tilemap->scroll_y, sizeof(int));
+  state_write(writer, tilemap->bitmap.data, pixels * sizeof(uint16_t));
+  state_write(writer, tilemap->bitmap.priority, pixels * sizeof(uint8_t));
+  state_end_section(writer);
+}
+
+static void rygar_load_tilemap(const uint8_t *data, tilemap_t *tilemap) {
+  size_t pixels = tilemap->bitmap.width * tilemap->bitmap.height;
+
+  memcpy(tilemap->tiles, data, sizeof(tilemap->tiles));
+  data += sizeof(tilemap->tiles);
+  memcpy(&tilemap->scroll_x, data, sizeof(int));
+  data += sizeof(int);
+  memcpy(&tilemap->scroll_y, data, sizeof(int));
+  data += sizeof(int);
+  memcpy(tilemap->bitmap.data, data, pixels * sizeof(uint16_t));
+  data += pixels * sizeof(uint16_t);
+  memcpy(tilemap->bitmap.priority, data, pixels * sizeof(uint8_t));
+}
+
+/* sizes of the save state sections */
+#define Z80_STATE_SIZE 55
+#define CPU_STATE_SIZE (sizeof(uint32_t) + Z80_STATE_SIZE + sizeof(uint64_t))
+#define REGS_STATE_SIZE 12
+#define EVENT_STATE_SIZE (sizeof(uint64_t) + sizeof(int32_t))
+#define SCHED_STATE_SIZE                                                      \
+  (sizeof(uint64_t) + sizeof(int32_t) + SCHED_MAX_EVENTS * EVENT_STATE_SIZE + \
+   2 * sizeof(uint64_t) + 1)
+
+/* the 16-bit registers of the Z80, in the order they are saved */
+#define Z80_STATE_REGS(cpu)                                                    \
+  &(cpu)->pc, &(cpu)->af, &(cpu)->bc, &(cpu)->de, &(cpu)->hl, &(cpu)->ix,      \
+      &(cpu)->iy, &(cpu)->wz, &(cpu)->sp, &(cpu)->ir, &(cpu)->af2,             \
+      &(cpu)->bc2, &(cpu)->de2, &(cpu)->hl2
+
+/**
+ * Writes the state of the Z80 field by field, so the state doesn't include
+ * any padding bytes or depend on the layout of z80_t, and can be hashed.
+ */
+static void rygar_save_z80(state_writer_t *writer, const z80_t *cpu) {
+  const uint16_t *regs[] = {Z80_STATE_REGS(cpu)};
+  uint8_t flags[] = {cpu->hlx_idx, cpu->prefix_active, cpu->im, cpu->iff1,
+                     cpu->iff2};
+
+  state_write(writer, &cpu->step, sizeof(uint16_t));
+  state_write(writer, &cpu->addr, sizeof(uint16_t));
+  state_write(writer, &cpu->dlatch, 1);
+  state_write(writer, &cpu->opcode, 1);
+  state_write(writer, &cpu->pins, sizeof(uint64_t));
+  state_write(writer, &cpu->int_bits, sizeof(uint64_t));
+
+  for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+    state_write(writer, regs[i], sizeof(uint16_t));
+  }
+
+  state_write(writer, flags, sizeof(flags));
+}
+
+/**
+ * Reads the state of the Z80 written by rygar_save_z80. Returns false if the
+ * state isn't valid, in which case the Z80 is left untouched.
+ */
+static bool rygar_load_z80(const uint8_t *data, z80_t *cpu) {
+  const uint8_t *flags = data + Z80_STATE_SIZE - 5;
+  z80_t z80 = *cpu;
+  uint16_t *regs[] = {Z80_STATE_REGS(&z80)};
+
+  if (flags[0] > 2 || flags[1] > 1 || flags[2] > 2 || flags[3] > 1 ||
+      flags[4] > 1) {
+    return false;
+  }
+
+  memcpy(&z80.step, data, sizeof(uint16_t));
+  memcpy(&z80.addr, data + 2, sizeof(uint16_t));
+  z80.dlatch = data[4];
+  z80.opcode = data[5];
+  memcpy(&z80.pins, data + 6, sizeof(uint64_t));
+  memcpy(&z80.int_bits, data + 14, sizeof(uint64_t));
+  data += 22;
+
+  for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+    memcpy(regs[i], data, sizeof(uint16_t));
+    data += sizeof(uint16_t);
+  }
+
+  z80.hlx_idx = flags[0];
+  z80.prefix_active = flags[1];
+  z80.im = flags[2];
+  z80.iff1 = flags[3];
+  z80.iff2 = flags[4];
+  *cpu = z80;
+
+  return true;
+}
+
+/**
+ * Writes the sections which are needed to run the machine.
+ */
+static void rygar_save_core(rygar_t *rygar, state_writer_t *writer) {
+  mainboard_t *main = &rygar->main;
+  uint32_t cpu_mode = rygar->cpu_mode;
+
+  state_begin_section(writer, "CPU ");
+  state_write(writer, &cpu_mode, sizeof(uint32_t));
+  rygar_save_z80(writer, &main->cpu);
+  state_write(writer, &main->pins, sizeof(uint64_t));
+  state_end_section(writer);
+
+  state_begin_section(writer, "RAM ");
+  state_write(writer, main->work_ram, WORK_RAM_SIZE);
+  state_write(writer, main->char_ram, CHAR_RAM_SIZE);
+  state_write(writer, main->fg_ram, FG_RAM_SIZE);
+  state_write(writer, main->bg_ram, BG_RAM_SIZE);
+  state_write(writer, main->sprite_ram, SPRITE_RAM_SIZE);
+  state_write(writer, main->palette_ram, PALETTE_RAM_SIZE);
+  state_end_section(writer);
+
+  state_begin_section(writer, "REGS");
+  state_write(writer, &main->current_bank, 1);
+  state_write(writer, &main->joystick, 1);
+  state_write(writer, &main->buttons, 1);
+  state_write(writer, &main->joystick2, 1);
+  state_write(writer, &main->buttons2, 1);
+  state_write(writer, &main->sys, 1);
+  state_write(writer, main->fg_scroll, 3);
+  state_write(writer, main->bg_scroll, 3);
+  state_end_section(writer);
+
+  /* the scheduler is written field by field, so the state doesn't include
+   * any padding bytes, and can be hashed */
+  int32_t count = rygar->sched.count;
+
+  state_begin_section(writer, "SCHD");
+  state_write(writer, &rygar->sched.now, sizeof(uint64_t));
+  state_write(writer, &count, sizeof(int32_t));
+
+  for (int i = 0; i < SCHED_MAX_EVENTS; i++) {
+    int32_t type = rygar->sched.events[i].type;
+    state_write(writer, &rygar->sched.events[i].time, sizeof(uint64_t));
+    state_write(writer, &type, sizeof(int32_t));
+  }
+
+  state_write(writer, &rygar->run_end, sizeof(uint64_t));
+  state_write(writer, &rygar->frame, sizeof(uint64_t));
+  state_write(writer, &rygar->vblank, 1);
+  state_end_section(writer);
+}
+
+/**
+ * Writes the sections of the derived video state.
+ */
+static void rygar_save_video(rygar_t *rygar, state_writer_t *writer) {
+  state_begin_section(writer, "PAL ");
+  state_write(writer, rygar->palette, sizeof(rygar->palette));
+  state_end_section(writer);
+
+  rygar_save_tilemap(writer, "CHAR", &rygar->char_tilemap);
+  rygar_save_tilemap(writer, "FG  ", &rygar->fg_tilemap);
+  rygar_save_tilemap(writer, "BG  ", &rygar->bg_tilemap);
+}
+
+/**
+ * Saves the machine state to the buffer, and returns its size.
+ *
+ * The state is made up of the following sections:
+ *
+ *   CPU:  the CPU core mode, registers and pins
+ *   RAM:  the RAM areas
+ *   REGS: the bank, input, and scroll registers
+ *   SCHD: the scheduler, the frame counter, and the VBLANK state
+ *   PAL:  the color palette cache
+ *   CHAR/FG/BG: the tiles and pixel data of the tilemaps
+ *
+ * The derived video state is included, even though it could be rebuilt from
+ * the RAM, so that loading a state takes no more than a few copies.
+ */
+size_t rygar_save_state(rygar_t *rygar, void *data, size_t size) {
+  state_writer_t writer;
+
+  state_writer_init(&writer, data, size, RYGAR_STATE_VERSION);
+  rygar_save_core(rygar, &writer);
+  rygar_save_video(rygar, &writer);
+
+  return state_writer_size(&writer);
+}
+
+/**
+ * Saves the machine state without the derived video state, which is rebuilt
+ * when the state is loaded. The size is always the same.
+ */
+size_t rygar_save_core_state(rygar_t *rygar, void *data, size_t size) {
+  state_writer_t writer;
+
+  state_writer_init(&writer, data, size, RYGAR_STATE_VERSION);
+  rygar_save_core(rygar, &writer);
+
+  return state_writer_size(&writer);
+}
+
+/**
+ * Loads the machine state from the buffer.
+ *
+ * All the sections are checked before anything is loaded, so the machine is
+ * left untouched if the state is invalid. The video sections are optional,
+ * and are rebuilt from the RAM if they are missing.
+ */
+bool rygar_load_state(rygar_t *rygar, const void *data, size_t size) {
+  mainboard_t *main = &rygar->main;
+  state_reader_t reader;
+  uint32_t cpu_mode;
+  int32_t count;
+
+  if (!state_reader_init(&reader, data, size, RYGAR_STATE_VERSION)) {
+    return false;
+  }
+
+  const uint8_t *cpu = state_find_section(&reader, "CPU ", CPU_STATE_SIZE);
+  const uint8_t *ram = state_find_section(&reader, "RAM ", RAM_SIZE);
+  const uint8_t *regs = state_find_section(&reader, "REGS", REGS_STATE_SIZE);
+  const uint8_t *sched =
+      state_find_section(&reader, "SCHD", SCHED_STATE_SIZE);
+  const uint8_t *palette =
+      state_find_section(&reader, "PAL ", sizeof(rygar->palette));
+  const uint8_t *char_tilemap = state_find_section(
+      &reader, "CHAR", rygar_tilemap_state_size(&rygar->char_tilemap));
+  const uint8_t *fg_tilemap = state_find_section(
+      &reader, "FG  ", rygar_tilemap_state_size(&rygar->fg_tilemap));
+  const uint8_t *bg_tilemap = state_find_section(
+      &reader, "BG  ", rygar_tilemap_state_size(&rygar->bg_tilemap));
+
+  if (!cpu || !ram || !regs || !sched) {
+    return false;
+  }
+
+  memcpy(&cpu_mode, cpu, sizeof(uint32_t));
+  memcpy(&count, sched + sizeof(uint64_t), sizeof(int32_t));
+
+  /* the pins mean different things to the cycle-stepped and
+   * instruction-stepped cores, so the state must be loaded into a machine
+   * running the same core */
+  if (cpu_mode != rygar->cpu_mode ||
+      regs[0] >= BANK_SIZE / BANK_WINDOW_SIZE || count < 0 ||
+      count > SCHED_MAX_EVENTS) {
+    return false;
+  }
+
+  /* the pending events are dispatched on their type */
+  const uint8_t *events = sched + sizeof(uint64_t) + sizeof(int32_t);
+
+  for (int i = 0; i < count; i++) {
+    int32_t type;
+
+    memcpy(&type, events + i * EVENT_STATE_SIZE + sizeof(uint64_t),
+           sizeof(int32_t));
+
+    if (type != EVENT_VBLANK_START && type != EVENT_VBLANK_END) {
+      return false;
+    }
   }
 
-  return SDL_APP_CONTINUE;
+  if (!rygar_load_z80(cpu + sizeof(uint32_t), &main->cpu)) {
+    return false;
+  }
+
+  memcpy(&main->pins, cpu + sizeof(uint32_t) + Z80_STATE_SIZE,
+         sizeof(uint64_t));
+
+  /* the RAM areas are contiguous in the address space */
+  memcpy(main->work_ram, ram + WORK_RAM_START - RAM_START, WORK_RAM_SIZE);
+  memcpy(main->char_ram, ram + CHAR_RAM_START - RAM_START, CHAR_RAM_SIZE);
+  memcpy(main->fg_ram, ram + FG_RAM_START - RAM_START, FG_RAM_SIZE);
+  memcpy(main->bg_ram, ram + BG_RAM_START - RAM_START, BG_RAM_SIZE);
+  memcpy(main->sprite_ram, ram + SPRITE_RAM_START - RAM_START,
+         SPRITE_RAM_SIZE);
+  memcpy(main->palette_ram, ram + PALETTE_RAM_START - RAM_START,
+         PALETTE_RAM_SIZE);
+
+  rygar_switch_bank(rygar, regs[0]);
+  main->joystick = regs[1];
+  main->buttons = regs[2];
+  main->joystick2 = regs[3];
+  main->buttons2 = regs[4];
+  main->sys = regs[5];
+  memcpy(main->fg_scroll, regs + 6, 3);
+  memcpy(main->bg_scroll, regs + 9, 3);
+
+  memcpy(&rygar->sched.now, sched, sizeof(uint64_t));
+  sched += sizeof(uint64_t);
+  memcpy(&count, sched, sizeof(int32_t));
+  rygar->sched.count = count;
+  sched += sizeof(int32_t);
+
+  for (int i = 0; i < SCHED_MAX_EVENTS; i++) {
+    int32_t type;
+    memcpy(&rygar->sched.events[i].time, sched, sizeof(uint64_t));
+    memcpy(&type, sched + sizeof(uint64_t), sizeof(int32_t));
+    rygar->sched.events[i].type = type;
+    sched += EVENT_STATE_SIZE;
+  }
+
+  memcpy(&rygar->run_end, sched, sizeof(uint64_t));
+  memcpy(&rygar->frame, sched + sizeof(uint64_t), sizeof(uint64_t));
+  rygar->vblank = sched[2 * sizeof(uint64_t)];
+
+  if (palette) {
+    memcpy(rygar->palette, palette, sizeof(rygar->palette));
+  } else {
+    for (int i = 0; i < PALETTE_RAM_SIZE; i++) {
+      rygar_update_palette(rygar, i, main->palette_ram[i]);
+    }
+  }
+
+  if (char_tilemap && fg_tilemap && bg_tilemap) {
+    rygar_load_tilemap(char_tilemap, &rygar->char_tilemap);
+    rygar_load_tilemap(fg_tilemap, &rygar->fg_tilemap);
+    rygar_load_tilemap(bg_tilemap, &rygar->bg_tilemap);
+  } else {
+    tilemap_mark_all_dirty(&rygar->char_tilemap);
+    tilemap_mark_all_dirty(&rygar->fg_tilemap);
+    tilemap_mark_all_dirty(&rygar->bg_tilemap);
+    rygar_write_fg_scroll(rygar, FG_SCROLL_START, main->fg_scroll[0]);
+    rygar_write_bg_scroll(rygar, BG_SCROLL_START, main->bg_scroll[0]);
+  }
+
+  /* the tilemaps are resolved again with the restored palette */
+  if (rygar->rgba) {
+    tilemap_set_palette(&rygar->char_tilemap, rygar->palette);
+    tilemap_set_palette(&rygar->fg_tilemap, rygar->palette);
+    tilemap_set_palette(&rygar->bg_tilemap, rygar->palette);
+  }
+
+  rygar->palette_dirty = 0;
+
+  /* the loop being watched is no longer valid */
+  rygar->idle.probing = false;
+
+  return true;
 }
 
-/* This function runs once per frame, and is the heart of the program. */
-SDL_AppResult SDL_AppIterate(void *appstate) {
-  uint32_t ticks = SDL_GetTicks();
-  uint32_t delta = ticks - prev_ticks;
-  uint32_t *pixels;
-  int pitch;
+/* a function which saves the machine state to a buffer */
+typedef size_t (*rygar_save_t)(rygar_t *rygar, void *data, size_t size);
+
+/**
+ * Saves the machine state to a file with the given save function.
+ */
+static bool rygar_save_file(rygar_t *rygar, const char *path,
+                            rygar_save_t save) {
+  size_t size = save(rygar, NULL, 0);
+  void *data = malloc(size);
 
-  if (delta > 24) {
-    delta = 24;
+  if (!data) {
+    return false;
   }
 
-  if (!SDL_LockTexture(texture, NULL, (void **)&pixels, &pitch)) {
-    SDL_Log("Couldn't lock texture: %s", SDL_GetError());
-    return SDL_APP_FAILURE;
+  save(rygar, data, size);
+
+  bool ok = state_write_file(path, data, size);
+
+  free(data);
+
+  return ok;
+}
+
+bool rygar_save_state_file(rygar_t *rygar, const char *path) {
+  return rygar_save_file(rygar, path, rygar_save_state);
+}
+
+bool rygar_load_state_file(rygar_t *rygar, const char *path) {
+  size_t size;
+  const void *data = state_map_file(path, &size);
+
+  if (!data) {
+    return false;
   }
 
-  rygar_exec(delta, pixels);
+  bool ok = rygar_load_state(rygar, data, size);
+
+  state_unmap_file(data, size);
+
+  return ok;
+}
 
-  SDL_UnlockTexture(texture);
-  SDL_RenderTexture(renderer, texture, NULL, NULL);
-  SDL_RenderPresent(renderer);
+/**
+ * Returns the 64-bit FNV-1a hash of the ROMs, which identifies the ROM set a
+ * boot cache was made from.
+ */
+static uint64_t rygar_rom_hash() {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (int i = 0; i < ROM_COUNT; i++) {
+    for (size_t j = 0; j < rom_files[i].size; j++) {
+      hash ^= roms[i][j];
+      hash *= 0x100000001b3ULL;
+    }
+  }
+
+  return hash;
+}
+
+/**
+ * Saves a boot cache to the buffer, and returns its size.
+ *
+ * A boot cache is a full save state with two extra sections:
+ *
+ *   ROMS: the hash of the ROMs
+ *   TILE: the decoded tile ROMs
+ *
+ * so it can also be loaded like any other save state.
+ */
+static size_t rygar_save_boot(rygar_t *rygar, void *data, size_t size) {
+  state_writer_t writer;
+  uint64_t hash = rygar_rom_hash();
+
+  state_writer_init(&writer, data, size, RYGAR_STATE_VERSION);
+  rygar_save_core(rygar, &writer);
+  rygar_save_video(rygar, &writer);
+
+  state_begin_section(&writer, "ROMS");
+  state_write(&writer, &hash, sizeof(uint64_t));
+  state_end_section(&writer);
+
+  state_begin_section(&writer, "TILE");
+  /* the tiles decoded on demand are all needed for the boot cache */
+  for (int i = 0; i < TILE_ROM_COUNT; i++) {
+    tile_rom_decode_all(&tile_roms[i]);
+  }
+
+  const tile_rom_t *sprites = &tile_roms[SPRITE_TILES];
+
+  if (sprites->data) {
+    state_write(&writer, tile_roms[CHAR_TILES].data, TILE_ROMS_SIZE);
+  } else {
+    /* the 8-bit sprite tiles aren't kept when they are packed, so they are
+     * decoded again from the ROM chips */
+    uint8_t tile[TILE_MAX_SIZE];
+
+    state_write(&writer, tile_roms[CHAR_TILES].data,
+                TILE_ROMS_SIZE - SPRITE_ROM_SIZE);
+
+    for (int code = 0; code < sprites->count; code++) {
+      tile_rom_decode_tile(sprites, code, tile);
+      state_write(&writer, tile, sprites->tile_size);
+    }
+  }
 
-  prev_ticks = ticks;
+  state_end_section(&writer);
 
-  return SDL_APP_CONTINUE;
+  return state_writer_size(&writer);
 }
 
-/* This function runs once at shutdown. */
-void SDL_AppQuit(void *appstate, SDL_AppResult result) { rygar_shutdown(); }
+/**
+ * Returns the decoded tile ROMs in a boot cache, or NULL if the boot cache
+ * isn't valid for the ROMs and the CPU core.
+ */
+static const uint8_t *rygar_boot_tiles(const void *data, size_t size,
+                                       rygar_cpu_mode_t cpu_mode) {
+  state_reader_t reader;
+  uint64_t hash;
+  uint32_t mode;
+
+  if (!state_reader_init(&reader, data, size, RYGAR_STATE_VERSION)) {
+    return NULL;
+  }
+
+  const uint8_t *cpu = state_find_section(&reader, "CPU ", CPU_STATE_SIZE);
+  const uint8_t *roms = state_find_section(&reader, "ROMS", sizeof(uint64_t));
+  const uint8_t *tiles =
+      state_find_section(&reader, "TILE", TILE_ROMS_SIZE);
+
+  if (!cpu || !roms || !tiles) {
+    return NULL;
+  }
+
+  memcpy(&mode, cpu, sizeof(uint32_t));
+  memcpy(&hash, roms, sizeof(uint64_t));
+
+  return mode == cpu_mode && hash == rygar_rom_hash() ? tiles : NULL;
+}
+
+rygar_t *rygar_boot(const char *path, rygar_cpu_mode_t cpu_mode) {
+  static const char *cores[] = {"cycle", "instruction", "direct"};
+  char cache_path[4096];
+  size_t size = 0;
+
+  /* each core has its own boot cache, so booting with one core doesn't
+   * replace the boot cache of another */
+  if (snprintf(cache_path, sizeof(cache_path), "%s.%s", path,
+               cores[cpu_mode]) >= (int)sizeof(cache_path)) {
+    return NULL;
+  }
+
+  const void *data = state_map_file(cache_path, &size);
+  const uint8_t *tiles = data ? rygar_boot_tiles(data, size, cpu_mode) : NULL;
+
+  /* the tiles are copied from the boot cache, unless they have already been
+   * decoded by another instance, or were decoded at build time */
+  rygar_t *rygar = rygar_create_with_tiles(tiles);
+
+  if (!rygar) {
+    if (data) {
+      state_unmap_file(data, size);
+    }
+
+    return NULL;
+  }
+
+  rygar_set_cpu_mode(rygar, cpu_mode);
+
+  bool loaded = tiles && rygar_load_state(rygar, data, size);
+
+  if (data) {
+    state_unmap_file(data, size);
+  }
+
+  if (!loaded) {
+    /* the inputs are all released while the test runs, so the machine ends
+     * up in the same state as one which was just switched on */
+    for (int i = 0; i < RYGAR_BOOT_FRAMES; i++) {
+      rygar_run_frame(rygar, NULL);
+    }
+
+    /* the machine can still be used if the boot cache can't be written */
+    rygar_save_file(rygar, cache_path, rygar_save_boot);
+  }
+
+  return rygar;
+}
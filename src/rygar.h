@@ -0,0 +1,456 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chips/mem.h"
+#include "chips/z80.h"
+
+#include "bitmap.h"
+#include "movie.h"
+#include "sched.h"
+#include "tilemap.h"
+
+#define CHAR_ROM_SIZE 0x10000
+#define FG_ROM_SIZE 0x40000
+#define BG_ROM_SIZE 0x40000
+#define SPRITE_ROM_SIZE 0x40000
+
+/* the size of all the decoded tile roms */
+#define TILE_ROMS_SIZE \
+  (CHAR_ROM_SIZE + FG_ROM_SIZE + BG_ROM_SIZE + SPRITE_ROM_SIZE)
+
+#define WORK_RAM_SIZE 0x1000
+#define WORK_RAM_START 0xc000
+#define WORK_RAM_END (WORK_RAM_START + WORK_RAM_SIZE - 1)
+
+#define CHAR_RAM_SIZE 0x800
+#define CHAR_RAM_START 0xd000
+#define CHAR_RAM_END (CHAR_RAM_START + CHAR_RAM_SIZE - 1)
+
+#define FG_RAM_SIZE 0x400
+#define FG_RAM_START 0xd800
+#define FG_RAM_END (FG_RAM_START + FG_RAM_SIZE - 1)
+
+#define BG_RAM_SIZE 0x400
+#define BG_RAM_START 0xdc00
+#define BG_RAM_END (BG_RAM_START + BG_RAM_SIZE - 1)
+
+#define SPRITE_RAM_SIZE 0x800
+#define SPRITE_RAM_START 0xe000
+#define SPRITE_RAM_END (SPRITE_RAM_START + SPRITE_RAM_SIZE - 1)
+
+#define PALETTE_RAM_SIZE 0x800
+#define PALETTE_RAM_START 0xe800
+#define PALETTE_RAM_END (PALETTE_RAM_START + PALETTE_RAM_SIZE - 1)
+
+#define RAM_SIZE 0x3000
+#define RAM_START 0xc000
+#define RAM_END (RAM_START + RAM_SIZE - 1)
+
+#define BANK_SIZE 0x8000
+#define BANK_WINDOW_SIZE 0x800
+#define BANK_WINDOW_START 0xf000
+#define BANK_WINDOW_END (BANK_WINDOW_START + BANK_WINDOW_SIZE - 1)
+
+#define BUFFER_WIDTH 256
+#define BUFFER_HEIGHT 256
+
+#define SCREEN_WIDTH 256
+#define SCREEN_HEIGHT 224
+
+/* save state format version, this must be bumped whenever the saved state
+ * changes */
+#define RYGAR_STATE_VERSION 3
+
+/* the number of frames the power-on self test takes, after which the game
+ * shows the title screen */
+#define RYGAR_BOOT_FRAMES 400
+
+#define CPU_FREQ 6000000
+#define VSYNC_PERIOD_4MHZ (CPU_FREQ / 60)
+#define VBLANK_DURATION_4MHZ (((CPU_FREQ / 60) / 525) * (525 - 483))
+
+/* CPU core modes */
+typedef enum {
+  /* ticks the CPU one cycle at a time, with an accurate bus timing */
+  RYGAR_CPU_CYCLE,
+
+  /* executes a whole instruction at a time, which is much faster */
+  RYGAR_CPU_INSTRUCTION,
+
+  /* like RYGAR_CPU_INSTRUCTION, but plain RAM and ROM pages are accessed
+   * directly through the memory map, and only the I/O and video pages go
+   * through the bus handlers */
+  RYGAR_CPU_DIRECT,
+} rygar_cpu_mode_t;
+
+typedef struct rygar_t rygar_t;
+
+/* idle loop detector */
+typedef struct {
+  /* true while an iteration of a candidate loop is being watched */
+  bool probing;
+
+  /* true if the watched iteration had any side effects */
+  bool dirty;
+
+  /* the CPU state and time at the head of the candidate loop */
+  z80_t cpu;
+  uint64_t time;
+
+  /* ticks skipped since the start of the frame */
+  uint64_t skipped;
+} idle_t;
+
+/* bus handlers for a page in the main CPU address space */
+typedef uint8_t (*rygar_read_t)(rygar_t *rygar, uint16_t addr);
+typedef void (*rygar_write_t)(rygar_t *rygar, uint16_t addr, uint8_t data);
+
+/* A page in the main CPU address space. Each direction is either accessed
+ * directly through the host pointer, or through a handler if one is set. */
+typedef struct {
+  const uint8_t *read_ptr;
+  uint8_t *write_ptr;
+  rygar_read_t read;
+  rygar_write_t write;
+} rygar_page_t;
+
+typedef struct {
+  z80_t cpu;
+  mem_t mem;
+
+  /* the main CPU bus, indexed by page */
+  rygar_page_t pages[MEM_NUM_PAGES];
+
+  /* bit masks of the pages without read/write handlers */
+  uint64_t direct_read;
+  uint64_t direct_write;
+
+  uint64_t pins;
+
+  /* ram */
+  uint8_t work_ram[WORK_RAM_SIZE];
+  uint8_t char_ram[CHAR_RAM_SIZE];
+  uint8_t fg_ram[FG_RAM_SIZE];
+  uint8_t bg_ram[BG_RAM_SIZE];
+  uint8_t sprite_ram[SPRITE_RAM_SIZE];
+  uint8_t palette_ram[PALETTE_RAM_SIZE];
+
+  /* bank switched rom */
+  const uint8_t *banked_rom;
+  uint8_t current_bank;
+
+  /* decoded tile roms (shared by all instances) */
+  const tile_rom_t *char_rom;
+  const tile_rom_t *fg_rom;
+  const tile_rom_t *bg_rom;
+  const tile_rom_t *sprite_rom;
+
+  /* input registers */
+  uint8_t joystick;
+  uint8_t buttons;
+  uint8_t joystick2;
+  uint8_t buttons2;
+  uint8_t sys;
+
+  /* tilemap scroll offset registers */
+  uint8_t fg_scroll[3];
+  uint8_t bg_scroll[3];
+} mainboard_t;
+
+struct rygar_t {
+  mainboard_t main;
+
+  bitmap_t bitmap;
+
+  /* tilemaps */
+  tilemap_t char_tilemap;
+  tilemap_t fg_tilemap;
+  tilemap_t bg_tilemap;
+
+  /* 32-bit RGBA color palette cache */
+  uint32_t palette[1024];
+
+  /* the banks of 16 colors in the palette which have changed since the last
+   * frame was drawn, bit n is set for colors n * 16 to n * 16 + 15 */
+  uint64_t palette_dirty;
+
+  /* true if the layers are drawn with 32-bit colors */
+  bool rgba;
+
+  /* CPU core mode */
+  rygar_cpu_mode_t cpu_mode;
+
+  /* timed events */
+  sched_t sched;
+
+  /* idle loop skipping */
+  bool idle_skip;
+  idle_t idle;
+
+  /* ticks skipped in idle loops during the last frame */
+  uint64_t skipped_ticks;
+
+  /* the tick on which the last run was due to end, the CPU may be a few
+   * cycles past it in instruction-stepped mode */
+  uint64_t run_end;
+
+  /* the number of frames run */
+  uint64_t frame;
+
+  /* the distance between the rows of the frame buffer (in bytes) */
+  int pitch;
+
+  /* the state saved while running ahead */
+  uint8_t *run_ahead_state;
+  size_t run_ahead_size;
+
+  /* true while the VBLANK interrupt is active */
+  bool vblank;
+
+  bool capture;
+};
+
+/**
+ * Initialises the Rygar arcade hardware.
+ */
+void rygar_init(rygar_t *rygar);
+
+/**
+ * Frees the resources used by the Rygar arcade hardware.
+ */
+void rygar_shutdown(rygar_t *rygar);
+
+/**
+ * Allocates and initialises a new machine instance. Returns NULL if the
+ * machine couldn't be allocated.
+ *
+ * Any number of instances may be created, and they can be run concurrently
+ * from different threads. The ROMs and the decoded tile data are shared
+ * between all instances.
+ */
+rygar_t *rygar_create();
+
+/**
+ * Allocates a new machine instance like rygar_create, which has already been
+ * run through the power-on self test with the given CPU core. Returns NULL if
+ * the machine couldn't be allocated.
+ *
+ * The machine state at the end of the test is restored from the boot cache
+ * file, along with the decoded tile data. If the file is missing, or doesn't
+ * match the ROMs, then the test is run and the file is written for the next
+ * time. Each CPU core has its own boot cache, which is the given path with
+ * ".cycle", ".instruction", or ".direct" appended.
+ */
+rygar_t *rygar_boot(const char *path, rygar_cpu_mode_t cpu_mode);
+
+/**
+ * Shuts down and frees a machine instance created with rygar_create or
+ * rygar_boot.
+ */
+void rygar_destroy(rygar_t *rygar);
+
+/**
+ * Loads the ROM set listed in rygar-roms.yml from a directory, or from an
+ * uncompressed tar archive, to use instead of the ROMs built into the binary.
+ * This must be called before any machine is created.
+ *
+ * The ROM files are mapped read-only and used in place, so every process
+ * running from the same files shares one copy of them. Returns false if any
+ * of the files is missing, or doesn't match the size and CRC-32 of the Rygar
+ * ROMs, in which case the name of the file (or the path, if it can't be read)
+ * is returned in error.
+ */
+bool rygar_load_roms(const char *path, const char **error);
+
+/**
+ * Enables decoding each tile the first time it is drawn, rather than decoding
+ * all the tiles when the first machine is created. This must be called before
+ * any machine is created, and only applies if the tiles weren't decoded at
+ * build time.
+ *
+ * Most of the tiles are never drawn in a short run, so this makes starting up
+ * faster, and keeps the undecoded tiles out of memory.
+ */
+void rygar_set_lazy_tiles(bool enabled);
+
+/**
+ * Enables drawing the sprites from a packed copy of the sprite ROM, with 4
+ * bits per pixel and a mask of the opaque pixels in each row. This must be
+ * called before any machine is created.
+ *
+ * The packed sprites take up less of the cache when they are drawn from all
+ * over the sprite ROM, and blank tiles and rows are skipped. The 8-bit sprite
+ * tiles aren't kept, and the tilemaps are still drawn from the 8-bit tiles.
+ */
+void rygar_set_packed_tiles(bool enabled);
+
+/**
+ * Enables keeping the sprite tiles flipped horizontally, vertically, and both
+ * ways, so that flipped sprites are drawn forwards. This must be called before
+ * any machine is created.
+ *
+ * The flipped tiles take up another 768 KB. They are flipped as the tiles are
+ * decoded, so they are only built on first use if the tiles are decoded on
+ * demand.
+ */
+void rygar_set_flipped_sprites(bool enabled);
+
+/**
+ * Decodes the char, fg, bg, and sprite tile ROMs one after the other to the
+ * buffer, which must be TILE_ROMS_SIZE bytes. The tiles are decoded with the
+ * slower generic decoder if generic is true, which is used to check the
+ * packed tile decoder.
+ *
+ * The core normally uses tile ROMs which were decoded at build time by
+ * tilegen, in which case this is only used by tools.
+ */
+void rygar_decode_tile_roms(uint8_t *dst, bool generic);
+
+/**
+ * This callback function is called for every CPU tick.
+ */
+uint64_t rygar_tick_main(rygar_t *rygar, uint64_t pins);
+
+/**
+ * Runs the CPU for the given number of ticks, without drawing.
+ */
+void rygar_run(rygar_t *rygar, uint32_t ticks);
+
+/**
+ * Selects the CPU core used to run the machine. The cycle-stepped core is used
+ * by default.
+ */
+void rygar_set_cpu_mode(rygar_t *rygar, rygar_cpu_mode_t mode);
+
+/**
+ * Enables or disables skipping idle loops in the instruction-stepped CPU
+ * cores, which is enabled by default. Skipping doesn't change the emulation,
+ * it only saves the time spent executing the loops.
+ */
+void rygar_set_idle_skip(rygar_t *rygar, bool enabled);
+
+/**
+ * Sets the distance between the rows of the frame buffer (in bytes), which is
+ * SCREEN_WIDTH * 4 by default. This allows drawing straight into a locked
+ * texture, whose rows may be padded.
+ */
+void rygar_set_pitch(rygar_t *rygar, int pitch);
+
+/**
+ * Switches between drawing the layers with pens, which are resolved through
+ * the palette once the frame is complete, and drawing them with 32-bit colors.
+ *
+ * The tilemaps keep 32-bit colors for their tiles, which are only resolved
+ * again when the tiles or the colors they use change, so the frame doesn't
+ * need to be resolved through the palette. Loading a state resolves all the
+ * tilemaps again though, so this is slower when running ahead.
+ */
+void rygar_set_rgba(rygar_t *rygar, bool enabled);
+
+/**
+ * Draws the graphics layers to the 32-bit frame buffer.
+ */
+void rygar_draw(rygar_t *rygar, uint32_t *buffer);
+
+/**
+ * Runs the emulation up to the next VSYNC, and draws the completed frame to
+ * the 32-bit frame buffer. The frame isn't drawn if the buffer is NULL.
+ *
+ * Frames are timed by the emulated clock only, so the frontend is responsible
+ * for pacing them.
+ */
+void rygar_run_frame(rygar_t *rygar, uint32_t *buffer);
+
+/**
+ * Runs the emulation up to the next VSYNC like rygar_run_frame, then runs the
+ * given number of frames further ahead with the same inputs, and draws the
+ * last of them. The machine is then restored to the end of the first frame.
+ *
+ * This hides the frames of input lag built into the game, as the effect of an
+ * input is seen as soon as it is made.
+ *
+ * The frames ahead are only run to be drawn, so if buffer is NULL, this only
+ * runs a single frame like rygar_run_frame.
+ */
+void rygar_run_ahead(rygar_t *rygar, int frames, uint32_t *buffer);
+
+/**
+ * Records the input registers for the next frame to the movie, or sets them
+ * from the movie when it is being played. Returns false if the movie has
+ * ended.
+ */
+bool rygar_movie_frame(rygar_t *rygar, movie_t *movie);
+
+/**
+ * Saves the machine state to the buffer, and returns the size of the state.
+ * The state is incomplete if it is larger than the buffer, so the buffer may
+ * be NULL to find the size needed.
+ */
+size_t rygar_save_state(rygar_t *rygar, void *data, size_t size);
+
+/**
+ * Saves the machine state like rygar_save_state, but without the video state
+ * which can be derived from the RAM. This is much smaller and quicker to save,
+ * but the video state needs to be rebuilt when it is loaded.
+ */
+size_t rygar_save_core_state(rygar_t *rygar, void *data, size_t size);
+
+/**
+ * Loads the machine state from the buffer. Returns false if the buffer doesn't
+ * contain a valid state, in which case the machine is left untouched.
+ *
+ * The state must have been saved by a machine running the same CPU core, so
+ * the core needs to be switched with rygar_set_cpu_mode before loading a state
+ * saved with another core.
+ */
+bool rygar_load_state(rygar_t *rygar, const void *data, size_t size);
+
+/**
+ * Saves the machine state to a file. Returns false if the file couldn't be
+ * written.
+ */
+bool rygar_save_state_file(rygar_t *rygar, const char *path);
+
+/**
+ * Loads the machine state from a file, which is mapped into memory rather than
+ * read. Returns false if the file doesn't contain a valid state.
+ */
+bool rygar_load_state_file(rygar_t *rygar, const char *path);
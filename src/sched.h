@@ -0,0 +1,92 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* maximum number of pending events */
+#define SCHED_MAX_EVENTS 8
+
+/* returned when there are no pending events */
+#define SCHED_NONE -1
+
+/* a timed event */
+typedef struct {
+  /* the tick on which the event fires */
+  uint64_t time;
+
+  /* the event type */
+  int type;
+} sched_event_t;
+
+/* the scheduler */
+typedef struct {
+  /* the current time (in ticks) */
+  uint64_t now;
+
+  /* number of pending events */
+  int count;
+
+  /* pending events, sorted by time */
+  sched_event_t events[SCHED_MAX_EVENTS];
+} sched_t;
+
+/**
+ * Initialises the scheduler.
+ */
+void sched_init(sched_t *sched);
+
+/**
+ * Schedules an event of the given type to fire on the given tick.
+ *
+ * Events scheduled for the same tick fire in the order they were added.
+ */
+void sched_add(sched_t *sched, int type, uint64_t time);
+
+/**
+ * Returns the time of the next pending event, or UINT64_MAX if there are no
+ * pending events.
+ */
+static inline uint64_t sched_next(const sched_t *sched) {
+  return sched->count > 0 ? sched->events[0].time : UINT64_MAX;
+}
+
+/**
+ * Removes the next event which is due at the current time, and returns its
+ * type. Returns SCHED_NONE if there are no events due.
+ */
+int sched_pop(sched_t *sched);
@@ -37,7 +37,7 @@
 
 #include <stdbool.h>
 
-void sprite_draw(bitmap_t *bitmap, uint8_t *ram, uint8_t *rom,
+void sprite_draw(bitmap_t *bitmap, uint8_t *ram, const tile_rom_t *rom,
                  uint16_t palette_offset, uint8_t flags) {
   /* Sprites are sorted from highest to lowest priority, so we need to iterate
    * backwards to ensure that the sprites with the highest priority are drawn
@@ -84,14 +84,17 @@ void sprite_draw(bitmap_t *bitmap, uint8_t *ram, uint8_t *rom,
         break; /* obscured by background */
       }
 
+      /* all the tiles of a sprite are drawn with the same variant */
+      tile_draw_fn_t draw = tile_draw_variant(TILE_WIDTH, TILE_HEIGHT, flip_x,
+                                              flip_y, flags & TILE_OPAQUE);
+
       for (int row = 0; row < size; row++) {
         for (int col = 0; col < size; col++) {
           int x = xpos + TILE_WIDTH * (flip_x ? (size - 1 - col) : col);
           int y = ypos + TILE_HEIGHT * (flip_y ? (size - 1 - row) : row);
 
-          tile_draw(bitmap, rom, code + sprite_tile_offset_table[row][col],
-                    color, palette_offset, x, y, TILE_WIDTH, TILE_HEIGHT,
-                    flip_x, flip_y, priority_mask, flags);
+          draw(bitmap, rom, code + sprite_tile_offset_table[row][col], color,
+               palette_offset, x, y, priority_mask, flags);
         }
       }
     }
@@ -87,6 +87,6 @@ static const uint8_t sprite_tile_offset_table[TILE_HEIGHT][TILE_WIDTH] = {
  */
 void sprite_draw(bitmap_t *bitmap,
                  uint8_t *ram,
-                 uint8_t *rom,
+                 const tile_rom_t *rom,
                  uint16_t palette_offset,
                  uint8_t flags);
@@ -0,0 +1,193 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "state.h"
+
+/* the size of the file and section headers */
+#define HEADER_SIZE 8
+
+static void state_put(state_writer_t *writer, const void *data, size_t size) {
+  if (writer->pos + size <= writer->size) {
+    memcpy(writer->data + writer->pos, data, size);
+  }
+
+  writer->pos += size;
+}
+
+void state_writer_init(state_writer_t *writer, void *data, size_t size,
+                       uint32_t version) {
+  writer->data = (uint8_t *)data;
+  writer->size = data ? size : 0;
+  writer->pos = 0;
+  writer->section = 0;
+
+  state_put(writer, STATE_MAGIC, 4);
+  state_put(writer, &version, 4);
+}
+
+void state_begin_section(state_writer_t *writer, const char *tag) {
+  uint32_t size = 0;
+
+  writer->section = writer->pos;
+  state_put(writer, tag, 4);
+  state_put(writer, &size, 4);
+}
+
+void state_write(state_writer_t *writer, const void *data, size_t size) {
+  state_put(writer, data, size);
+}
+
+void state_end_section(state_writer_t *writer) {
+  static const uint8_t padding[STATE_ALIGN] = {0};
+  uint32_t size = writer->pos - writer->section - HEADER_SIZE;
+
+  /* patch the section size */
+  if (writer->pos <= writer->size) {
+    memcpy(writer->data + writer->section + 4, &size, 4);
+  }
+
+  state_put(writer, padding, -writer->pos & (STATE_ALIGN - 1));
+}
+
+bool state_reader_init(state_reader_t *reader, const void *data, size_t size,
+                       uint32_t version) {
+  uint32_t v;
+
+  reader->data = (const uint8_t *)data;
+  reader->size = size;
+
+  if (size < HEADER_SIZE || memcmp(data, STATE_MAGIC, 4) != 0) {
+    return false;
+  }
+
+  memcpy(&v, reader->data + 4, 4);
+
+  return v == version;
+}
+
+const uint8_t *state_find_section(const state_reader_t *reader,
+                                  const char *tag, size_t size) {
+  size_t pos = HEADER_SIZE;
+
+  while (reader->size - pos >= HEADER_SIZE) {
+    const uint8_t *header = reader->data + pos;
+    uint32_t n;
+
+    memcpy(&n, header + 4, 4);
+
+    if (n > reader->size - pos - HEADER_SIZE) {
+      return NULL;
+    }
+
+    if (memcmp(header, tag, 4) == 0) {
+      return n == size ? header + HEADER_SIZE : NULL;
+    }
+
+    pos += HEADER_SIZE + ((n + STATE_ALIGN - 1) & ~(size_t)(STATE_ALIGN - 1));
+
+    if (pos > reader->size) {
+      return NULL;
+    }
+  }
+
+  return NULL;
+}
+
+bool state_write_file(const char *path, const void *data, size_t size) {
+  char tmp_path[4096];
+
+  /* The file is written next to the original, then renamed over it, so the
+   * original is never left half written, or truncated while another process
+   * has it mapped. The process ID keeps concurrent writers apart. */
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path,
+               (long)getpid()) >= (int)sizeof(tmp_path)) {
+    return false;
+  }
+
+  FILE *file = fopen(tmp_path, "wb");
+
+  if (!file) {
+    return false;
+  }
+
+  bool ok = fwrite(data, 1, size, file) == size && fflush(file) == 0 &&
+            fsync(fileno(file)) == 0;
+
+  ok = fclose(file) == 0 && ok && rename(tmp_path, path) == 0;
+
+  if (!ok) {
+    remove(tmp_path);
+  }
+
+  return ok;
+}
+
+const void *state_map_file(const char *path, size_t *size) {
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0) {
+    return NULL;
+  }
+
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  /* the mapping stays valid after the file is closed */
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+
+  *size = st.st_size;
+
+  return data;
+}
+
+void state_unmap_file(const void *data, size_t size) {
+  munmap((void *)data, size);
+}
@@ -0,0 +1,140 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A save state is a small header followed by a list of tagged sections:
+ *
+ *   header:  "RYGS" magic, u32 version
+ *   section: 4 character tag, u32 size, data padded to 8 bytes
+ *
+ * The data is stored in the host byte order, and the section contents are
+ * defined by the version. A byte swapped version won't match, so a state
+ * saved on a host with a different byte order is rejected. Sections are
+ * looked up by tag, so unknown sections are skipped over. */
+
+/* magic number at the start of the file */
+#define STATE_MAGIC "RYGS"
+
+/* all sections are aligned to this many bytes */
+#define STATE_ALIGN 8
+
+/* writes a save state to a buffer */
+typedef struct {
+  uint8_t *data;
+  size_t size;
+
+  /* the write position, which keeps counting past the end of the buffer */
+  size_t pos;
+
+  /* the position of the current section header */
+  size_t section;
+} state_writer_t;
+
+/* reads a save state from a buffer */
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+} state_reader_t;
+
+/**
+ * Starts writing a save state with the given version to the buffer.
+ *
+ * Nothing is written past the end of the buffer, so the buffer may be NULL to
+ * find the size of the save state.
+ */
+void state_writer_init(state_writer_t *writer, void *data, size_t size,
+                       uint32_t version);
+
+/**
+ * Starts a new section with the given 4 character tag.
+ */
+void state_begin_section(state_writer_t *writer, const char *tag);
+
+/**
+ * Appends data to the current section.
+ */
+void state_write(state_writer_t *writer, const void *data, size_t size);
+
+/**
+ * Ends the current section.
+ */
+void state_end_section(state_writer_t *writer);
+
+/**
+ * Returns the size of the save state. If it is larger than the buffer, then
+ * the save state is incomplete.
+ */
+static inline size_t state_writer_size(const state_writer_t *writer) {
+  return writer->pos;
+}
+
+/**
+ * Starts reading a save state from the buffer. Returns false if the buffer
+ * doesn't contain a save state of the given version.
+ */
+bool state_reader_init(state_reader_t *reader, const void *data, size_t size,
+                       uint32_t version);
+
+/**
+ * Returns the data of the section with the given tag, or NULL if there is no
+ * such section, or if it isn't the expected size.
+ */
+const uint8_t *state_find_section(const state_reader_t *reader,
+                                  const char *tag, size_t size);
+
+/**
+ * Writes a buffer to a file. Returns false if the file couldn't be written.
+ *
+ * The file is replaced atomically, so it holds either the old or the new
+ * contents if the write is interrupted, and any mappings of the old file stay
+ * valid.
+ */
+bool state_write_file(const char *path, const void *data, size_t size);
+
+/**
+ * Maps a file into memory read-only. Returns NULL if the file couldn't be
+ * mapped, otherwise the size of the file is returned in size.
+ */
+const void *state_map_file(const char *path, size_t *size);
+
+/**
+ * Unmaps a file mapped with state_map_file.
+ */
+void state_unmap_file(const void *data, size_t size);
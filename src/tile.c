@@ -33,6 +33,12 @@
  * SOFTWARE.
  */
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <sched.h>
+
 #include "tile.h"
 
 /**
@@ -45,9 +51,9 @@ static inline int read_bit(const uint8_t *rom, int offset) {
 }
 
 /**
- * Draws a single pixel.
+ * Draws a single pixel, as a pen and as a 32-bit color if the bitmap has them.
  */
-static inline void tile_draw_pixel(uint16_t *data, uint8_t *priority,
+static inline void tile_draw_pixel(bitmap_t *bitmap, int offset,
                                    uint8_t priority_mask,
                                    uint16_t palette_offset, uint8_t color,
                                    uint8_t pen, uint8_t flags) {
@@ -56,15 +62,23 @@ static inline void tile_draw_pixel(uint16_t *data, uint8_t *priority,
     return;
 
   /* bail out if there's already a pixel with higher priority */
-  if ((*priority & priority_mask) != 0)
+  if ((bitmap->priority[offset] & priority_mask) != 0)
     return;
 
-  *data = palette_offset | color << 4 | pen;
-  *priority = (pen != TRANSPARENT_PEN) ? flags & TILE_LAYER_MASK : 0;
+  uint16_t pixel = palette_offset | color << 4 | pen;
+
+  if (bitmap->data)
+    bitmap->data[offset] = pixel;
+
+  if (bitmap->rgba)
+    bitmap->rgba[offset] = bitmap->palette[pixel];
+
+  bitmap->priority[offset] =
+      (pen != TRANSPARENT_PEN) ? flags & TILE_LAYER_MASK : 0;
 }
 
-void tile_decode(const tile_decode_desc_t *desc, uint8_t *rom, uint8_t *dst,
-                 int count) {
+void tile_decode_generic(const tile_decode_desc_t *desc, const uint8_t *rom,
+                         uint8_t *dst, int count) {
   for (int tile = 0; tile < count; tile++) {
     uint8_t *ptr = dst + (tile * desc->tile_width * desc->tile_height);
 
@@ -91,17 +105,568 @@ void tile_decode(const tile_decode_desc_t *desc, uint8_t *rom, uint8_t *dst,
   }
 }
 
-void tile_draw(bitmap_t *bitmap, uint8_t *rom, uint16_t code, uint8_t color,
-               uint16_t palette_offset, int x, int y, int width, int height,
-               bool flip_x, bool flip_y, uint8_t priority_mask, uint8_t flags) {
+/**
+ * Returns true if the tiles are made up of packed 4-bit pixels, with the
+ * planes in the order of the bits in each pixel. Each row of the tile is then
+ * split into byte aligned runs of 8 pixels, which are stored in 4 bytes.
+ */
+static bool tile_is_packed(const tile_decode_desc_t *desc) {
+  if (desc->planes != 4 || desc->tile_width % 8 != 0)
+    return false;
+
+  for (int plane = 0; plane < desc->planes; plane++) {
+    if (desc->plane_offsets[plane] != plane)
+      return false;
+  }
+
+  for (int x = 0; x < desc->tile_width; x++) {
+    if (x % 8 == 0 ? desc->x_offsets[x] % 8 != 0
+                   : desc->x_offsets[x] != desc->x_offsets[x - 1] + 4)
+      return false;
+  }
+
+  for (int y = 0; y < desc->tile_height; y++) {
+    if (desc->y_offsets[y] % 8 != 0)
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * Expands a run of 8 packed 4-bit pixels, the high nibble of each byte is
+ * the first pixel.
+ */
+static inline void tile_expand_run(const uint8_t *src, uint8_t *dst) {
+  for (int i = 0; i < 4; i++) {
+    dst[i * 2] = src[i] >> 4;
+    dst[i * 2 + 1] = src[i] & 0x0f;
+  }
+}
+
+#ifdef __SSE2__
+/**
+ * Expands the runs of 8 pixels in four rows, which are stored one after the
+ * other in 16 bytes.
+ */
+static inline void tile_expand_runs_sse2(const uint8_t *src, uint8_t *dst,
+                                         int pitch) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  __m128i bytes = _mm_loadu_si128((const __m128i *)src);
+  __m128i hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+  __m128i lo = _mm_and_si128(bytes, mask);
+
+  /* interleave the nibbles, so each row of 8 pixels is in one half */
+  __m128i rows01 = _mm_unpacklo_epi8(hi, lo);
+  __m128i rows23 = _mm_unpackhi_epi8(hi, lo);
+
+  _mm_storel_epi64((__m128i *)dst, rows01);
+  _mm_storel_epi64((__m128i *)(dst + pitch), _mm_srli_si128(rows01, 8));
+  _mm_storel_epi64((__m128i *)(dst + pitch * 2), rows23);
+  _mm_storel_epi64((__m128i *)(dst + pitch * 3), _mm_srli_si128(rows23, 8));
+}
+#endif
+
+/**
+ * Decodes tiles of packed 4-bit pixels a byte at a time, rather than a bit at
+ * a time.
+ */
+static void tile_decode_packed(const tile_decode_desc_t *desc,
+                               const uint8_t *rom, uint8_t *dst, int count) {
+  int width = desc->tile_width;
+  int height = desc->tile_height;
+
+  for (int tile = 0; tile < count; tile++) {
+    const uint8_t *src = rom + tile * desc->tile_size;
+    uint8_t *ptr = dst + tile * width * height;
+
+    for (int x = 0; x < width; x += 8) {
+      int y = 0;
+
+#ifdef __SSE2__
+      /* four rows at a time, if they are stored one after the other */
+      for (; y + 4 <= height; y += 4) {
+        const int *y_offsets = &desc->y_offsets[y];
+
+        if (y_offsets[1] != y_offsets[0] + 32 ||
+            y_offsets[2] != y_offsets[0] + 64 ||
+            y_offsets[3] != y_offsets[0] + 96)
+          break;
+
+        tile_expand_runs_sse2(src + (y_offsets[0] + desc->x_offsets[x]) / 8,
+                              ptr + y * width + x, width);
+      }
+#endif
+
+      for (; y < height; y++) {
+        tile_expand_run(src + (desc->y_offsets[y] + desc->x_offsets[x]) / 8,
+                        ptr + y * width + x);
+      }
+    }
+  }
+}
+
+void tile_decode(const tile_decode_desc_t *desc, const uint8_t *rom,
+                 uint8_t *dst, int count) {
+  if (tile_is_packed(desc)) {
+    tile_decode_packed(desc, rom, dst, count);
+  } else {
+    tile_decode_generic(desc, rom, dst, count);
+  }
+}
+
+int tile_packed_size(int width, int height) {
+  if (width % 8 != 0 || width > 32)
+    return 0;
+
+  return width * height / 2 + height * width / 8;
+}
+
+void tile_pack(const uint8_t *tile, int width, int height, uint8_t *dst,
+               uint8_t *flags) {
+  uint8_t *masks = dst + width * height / 2;
+  int count = 0;
+
+  memset(dst, 0, tile_packed_size(width, height));
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int i = y * width + x;
+      uint8_t pen = tile[i] & 0xf;
+
+      dst[i / 2] |= pen << (i % 2 * 4);
+
+      if (pen != TRANSPARENT_PEN) {
+        masks[y * width / 8 + x / 8] |= 1 << (x % 8);
+        count++;
+      }
+    }
+  }
+
+  *flags = count == 0 ? TILE_BLANK : count == width * height ? TILE_SOLID : 0;
+}
+
+void tile_flip(const uint8_t *tile, int width, int height, uint8_t *dst) {
+  int size = width * height;
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t pen = tile[y * width + x];
+
+      dst[y * width + (width - 1 - x)] = pen;
+      dst[size + (height - 1 - y) * width + x] = pen;
+      dst[size * 2 + (height - 1 - y) * width + (width - 1 - x)] = pen;
+    }
+  }
+}
+
+void tile_rom_decode_tile(const tile_rom_t *rom, int code, uint8_t *dst) {
+  /* the tiles never straddle two ROM chips */
+  int tiles_per_bank = rom->bank_size / rom->desc->tile_size;
+  const uint8_t *src = rom->banks[code / tiles_per_bank] +
+                       (code % tiles_per_bank) * rom->desc->tile_size;
+
+  tile_decode(rom->desc, src, dst, 1);
+}
+
+/**
+ * Packs and flips the given tile of a tile ROM, from the decoded tile.
+ */
+static void tile_rom_convert(const tile_rom_t *rom, int code,
+                             const uint8_t *tile) {
+  int width = rom->desc->tile_width;
+  int height = rom->desc->tile_height;
+
+  if (rom->packed) {
+    tile_pack(tile, width, height,
+              (uint8_t *)rom->packed + code * rom->packed_size,
+              (uint8_t *)rom->tile_flags + code);
+  }
+
+  if (rom->flipped) {
+    tile_flip(tile, width, height,
+              (uint8_t *)rom->flipped + code * 3 * rom->tile_size);
+  }
+}
+
+void tile_rom_convert_all(const tile_rom_t *rom, const uint8_t *tiles) {
+  uint8_t tile[TILE_MAX_SIZE];
+
+  if (!rom->packed && !rom->flipped)
+    return;
+
+  for (int code = 0; code < rom->count; code++) {
+    if (tiles) {
+      tile_rom_convert(rom, code, tiles + code * rom->tile_size);
+    } else {
+      tile_rom_decode_tile(rom, code, tile);
+      tile_rom_convert(rom, code, tile);
+    }
+  }
+}
+
+void tile_rom_decode(const tile_rom_t *rom, int code) {
+  uint8_t state = TILE_UNDECODED;
+
+  /* only one thread decodes the tile, and any others wait for it */
+  if (!atomic_compare_exchange_strong_explicit(
+          &rom->states[code], &state, TILE_DECODING, memory_order_acquire,
+          memory_order_acquire)) {
+    /* decoding a tile is quick, so spin for a while before giving up the
+     * CPU, in case the decoding thread has been descheduled */
+    int spins = 0;
+
+    while (atomic_load_explicit(&rom->states[code], memory_order_acquire) !=
+           TILE_DECODED) {
+      if (spins++ < 64) {
+#ifdef __SSE2__
+        _mm_pause();
+#endif
+      } else {
+        sched_yield();
+      }
+    }
+
+    return;
+  }
+
+  /* the tile is decoded to a scratch tile if only the packed tiles are
+   * kept */
+  uint8_t scratch[TILE_MAX_SIZE];
+  uint8_t *tile =
+      rom->data ? (uint8_t *)rom->data + code * rom->tile_size : scratch;
+
+  tile_rom_decode_tile(rom, code, tile);
+  tile_rom_convert(rom, code, tile);
+
+  atomic_store_explicit(&rom->states[code], TILE_DECODED,
+                        memory_order_release);
+}
+
+void tile_rom_decode_all(const tile_rom_t *rom) {
+  for (int code = 0; code < rom->count; code++) {
+    tile_rom_ensure_decoded(rom, code);
+  }
+}
+
+#ifdef __SSE2__
+/**
+ * Draws a run of 8 pixels of a tile, which are read forwards, without
+ * branching on each pixel. The pens and priorities are selected under a mask
+ * of the pixels which are drawn, and only the 32-bit colors are stored one at
+ * a time.
+ */
+static inline void tile_draw_run(bitmap_t *bitmap, const uint8_t *src,
+                                 int offset, uint16_t pixel,
+                                 const uint32_t *colors, uint8_t priority_mask,
+                                 uint8_t layer, bool opaque) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i pens =
+      _mm_and_si128(_mm_loadl_epi64((const __m128i *)src), _mm_set1_epi8(0xf));
+  __m128i *priority = (__m128i *)(bitmap->priority + offset);
+  __m128i pri = _mm_loadl_epi64(priority);
+
+  /* the pixels which aren't transparent, and aren't masked by a pixel with a
+   * higher priority */
+  __m128i visible = _mm_andnot_si128(_mm_cmpeq_epi8(pens, zero),
+                                     _mm_set1_epi8((char)0xff));
+  __m128i draw = _mm_cmpeq_epi8(
+      _mm_and_si128(pri, _mm_set1_epi8(priority_mask)), zero);
+
+  if (!opaque) {
+    draw = _mm_and_si128(draw, visible);
+  }
+
+  __m128i layers = _mm_and_si128(visible, _mm_set1_epi8(layer));
+  _mm_storel_epi64(priority,
+                   _mm_or_si128(_mm_and_si128(draw, layers),
+                                _mm_andnot_si128(draw, pri)));
+
+  if (bitmap->data) {
+    __m128i *data = (__m128i *)(bitmap->data + offset);
+    __m128i pixels =
+        _mm_or_si128(_mm_unpacklo_epi8(pens, zero), _mm_set1_epi16(pixel));
+    __m128i mask = _mm_unpacklo_epi8(draw, draw);
+
+    _mm_storeu_si128(data, _mm_or_si128(_mm_and_si128(mask, pixels),
+                                        _mm_andnot_si128(
+                                            mask, _mm_loadu_si128(data))));
+  }
+
+  if (colors) {
+    int mask = _mm_movemask_epi8(draw);
+
+    for (int i = 0; i < 8; i++) {
+      if (mask & (1 << i))
+        bitmap->rgba[offset + i] = colors[src[i] & 0xf];
+    }
+  }
+}
+#endif
+
+/**
+ * Draws a tile which has been clipped to the bitmap, where u0, v0, u1, and v1
+ * are the visible rectangle of the tile.
+ *
+ * The variants below inline this with the dimensions, flipping, and opacity
+ * of the tile as constants, so the inner loop is left with the tests for the
+ * transparency and priority of each pixel.
+ */
+static inline __attribute__((always_inline)) void
+tile_draw_clipped(bitmap_t *bitmap, const uint8_t *tile, uint16_t pixel,
+                  int x, int y, int u0, int v0, int u1, int v1,
+                  uint8_t priority_mask, uint8_t flags, const int width,
+                  const int height, const bool flip_x, const bool flip_y,
+                  const bool opaque) {
+  uint8_t layer = flags & TILE_LAYER_MASK;
+  const uint32_t *colors = bitmap->rgba ? bitmap->palette + pixel : NULL;
+
+  for (int v = v0; v < v1; v++) {
+    const uint8_t *src = tile + (flip_y ? height - 1 - v : v) * width;
+    int offset = (y + v) * bitmap->width + x;
+    uint8_t *priority = bitmap->priority + offset;
+
+#ifdef __SSE2__
+    /* whole rows which are read forwards are drawn a run at a time */
+    if (!flip_x && width % 8 == 0 && u0 == 0 && u1 == width) {
+      for (int u = 0; u < width; u += 8) {
+        tile_draw_run(bitmap, src + u, offset + u, pixel, colors,
+                      priority_mask, layer, opaque);
+      }
+
+      continue;
+    }
+#endif
+
+    for (int u = u0; u < u1; u++) {
+      uint8_t pen = src[flip_x ? width - 1 - u : u] & 0xf;
+
+      if ((!opaque && pen == TRANSPARENT_PEN) || (priority[u] & priority_mask))
+        continue;
+
+      if (bitmap->data)
+        bitmap->data[offset + u] = pixel | pen;
+
+      if (colors)
+        bitmap->rgba[offset + u] = colors[pen];
+
+      priority[u] = (opaque && pen == TRANSPARENT_PEN) ? 0 : layer;
+    }
+  }
+}
+
+/**
+ * Returns the mask of the pixels which don't use the transparent pen in a row
+ * of a packed tile.
+ */
+static inline uint32_t tile_row_mask(const uint8_t *mask, int width) {
+  uint32_t value = 0;
+
+  for (int i = 0; i < width / 8; i++) {
+    value |= (uint32_t)mask[i] << (i * 8);
+  }
+
+  return value;
+}
+
+/**
+ * Unpacks a row of a packed tile to a pen in each byte.
+ */
+static inline void tile_unpack_row(const uint8_t *src, uint8_t *pens,
+                                   int width) {
+#ifdef __SSE2__
+  for (int i = 0; i < width / 2; i += 4) {
+    uint32_t bytes;
+    memcpy(&bytes, src + i, 4);
+
+    /* the low nibble of each byte is the first pen of the pair */
+    __m128i packed = _mm_cvtsi32_si128((int)bytes);
+    __m128i lo = _mm_and_si128(packed, _mm_set1_epi8(0xf));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), _mm_set1_epi8(0xf));
+    _mm_storel_epi64((__m128i *)(pens + i * 2), _mm_unpacklo_epi8(lo, hi));
+  }
+#else
+  for (int i = 0; i < width / 2; i++) {
+    pens[i * 2] = src[i] & 0xf;
+    pens[i * 2 + 1] = src[i] >> 4;
+  }
+#endif
+}
+
+/**
+ * Draws a packed tile which has been clipped to the bitmap, in the same way as
+ * tile_draw_clipped.
+ *
+ * Blank tiles and rows are skipped, unless the tile is opaque, and solid rows
+ * which aren't masked are stored without testing each pixel.
+ */
+static inline __attribute__((always_inline)) void
+tile_draw_clipped_packed(bitmap_t *bitmap, const tile_rom_t *rom, int code,
+                         uint16_t pixel, int x, int y, int u0, int v0, int u1,
+                         int v1, uint8_t priority_mask, uint8_t flags,
+                         const int width, const int height, const bool flip_x,
+                         const bool flip_y, const bool opaque) {
+  const uint8_t *tile = tile_rom_packed_tile(rom, code);
+
+  if (!opaque && (rom->tile_flags[code] & TILE_BLANK))
+    return;
+
+  const uint8_t *masks = tile + width * height / 2;
+  const uint32_t solid = (uint32_t)(((uint64_t)1 << width) - 1);
+  uint8_t layer = flags & TILE_LAYER_MASK;
+  const uint32_t *colors = bitmap->rgba ? bitmap->palette + pixel : NULL;
+
+  for (int v = v0; v < v1; v++) {
+    int row = flip_y ? height - 1 - v : v;
+    const uint8_t *src = tile + row * width / 2;
+    uint32_t mask = tile_row_mask(masks + row * width / 8, width);
+    int offset = (y + v) * bitmap->width + x;
+    uint8_t *priority = bitmap->priority + offset;
+    uint8_t pens[32];
+
+    if (!opaque && !mask)
+      continue;
+
+    /* unpack the row, so the pixels can be read in any order */
+    tile_unpack_row(src, pens, width);
+
+#ifdef __SSE2__
+    /* whole rows which are read forwards are drawn a run at a time */
+    if (!flip_x && u0 == 0 && u1 == width) {
+      for (int u = 0; u < width; u += 8) {
+        tile_draw_run(bitmap, pens + u, offset + u, pixel, colors,
+                      priority_mask, layer, opaque);
+      }
+
+      continue;
+    }
+#endif
+
+    if (mask == solid && !priority_mask) {
+      for (int u = u0; u < u1; u++) {
+        uint8_t pen = pens[flip_x ? width - 1 - u : u];
+
+        if (bitmap->data)
+          bitmap->data[offset + u] = pixel | pen;
+
+        if (colors)
+          bitmap->rgba[offset + u] = colors[pen];
+
+        priority[u] = layer;
+      }
+
+      continue;
+    }
+
+    for (int u = u0; u < u1; u++) {
+      uint8_t pen = pens[flip_x ? width - 1 - u : u];
+
+      if ((!opaque && pen == TRANSPARENT_PEN) || (priority[u] & priority_mask))
+        continue;
+
+      if (bitmap->data)
+        bitmap->data[offset + u] = pixel | pen;
+
+      if (colors)
+        bitmap->rgba[offset + u] = colors[pen];
+
+      priority[u] = (opaque && pen == TRANSPARENT_PEN) ? 0 : layer;
+    }
+  }
+}
+
+/**
+ * Clips a tile to the bitmap, and returns false if no part of it is visible.
+ */
+static inline bool tile_clip(const bitmap_t *bitmap, int x, int y, int width,
+                             int height, int *u0, int *v0, int *u1, int *v1) {
+  *u0 = x < 0 ? -x : 0;
+  *v0 = y < 0 ? -y : 0;
+  *u1 = x + width > bitmap->width ? bitmap->width - x : width;
+  *v1 = y + height > bitmap->height ? bitmap->height - y : height;
+
+  return *u0 < *u1 && *v0 < *v1;
+}
+
+#define TILE_DRAW_VARIANT(w, h, fx, fy, op)                                    \
+  static void tile_draw_##w##x##h##_##fx##fy##op(                              \
+      bitmap_t *bitmap, const tile_rom_t *rom, uint16_t code, uint8_t color,   \
+      uint16_t palette_offset, int x, int y, uint8_t priority_mask,            \
+      uint8_t flags) {                                                         \
+    int u0, v0, u1, v1;                                                        \
+                                                                               \
+    if (!tile_clip(bitmap, x, y, w, h, &u0, &v0, &u1, &v1))                    \
+      return;                                                                  \
+                                                                               \
+    if ((fx || fy) && rom->flipped) {                                          \
+      tile_draw_clipped(bitmap, tile_rom_flipped_tile(rom, code, fx, fy),      \
+                        palette_offset | color << 4, x, y, u0, v0, u1, v1,     \
+                        priority_mask, flags, w, h, false, false, op);         \
+    } else if (rom->packed) {                                                  \
+      tile_draw_clipped_packed(bitmap, rom, code, palette_offset | color << 4, \
+                               x, y, u0, v0, u1, v1, priority_mask, flags, w,  \
+                               h, fx, fy, op);                                 \
+    } else {                                                                   \
+      tile_draw_clipped(bitmap, tile_rom_tile(rom, code),                      \
+                        palette_offset | color << 4, x, y, u0, v0, u1, v1,     \
+                        priority_mask, flags, w, h, fx, fy, op);               \
+    }                                                                          \
+  }
+
+#define TILE_DRAW_VARIANTS(w, h)                                               \
+  TILE_DRAW_VARIANT(w, h, 0, 0, 0)                                             \
+  TILE_DRAW_VARIANT(w, h, 0, 0, 1)                                             \
+  TILE_DRAW_VARIANT(w, h, 0, 1, 0)                                             \
+  TILE_DRAW_VARIANT(w, h, 0, 1, 1)                                             \
+  TILE_DRAW_VARIANT(w, h, 1, 0, 0)                                             \
+  TILE_DRAW_VARIANT(w, h, 1, 0, 1)                                             \
+  TILE_DRAW_VARIANT(w, h, 1, 1, 0)                                             \
+  TILE_DRAW_VARIANT(w, h, 1, 1, 1)
+
+/* the variants of a tile size, indexed by flip_x, flip_y, and opacity */
+#define TILE_DRAW_TABLE(w, h)                                                  \
+  {                                                                            \
+    {{tile_draw_##w##x##h##_000, tile_draw_##w##x##h##_001},                   \
+     {tile_draw_##w##x##h##_010, tile_draw_##w##x##h##_011}},                  \
+        {{tile_draw_##w##x##h##_100, tile_draw_##w##x##h##_101},               \
+         {tile_draw_##w##x##h##_110, tile_draw_##w##x##h##_111}},              \
+  }
+
+TILE_DRAW_VARIANTS(8, 8)
+TILE_DRAW_VARIANTS(16, 16)
+
+static const tile_draw_fn_t tile_draw_8x8[2][2][2] = TILE_DRAW_TABLE(8, 8);
+static const tile_draw_fn_t tile_draw_16x16[2][2][2] = TILE_DRAW_TABLE(16, 16);
+
+tile_draw_fn_t tile_draw_variant(int width, int height, bool flip_x,
+                                 bool flip_y, bool opaque) {
+  if (width == 8 && height == 8)
+    return tile_draw_8x8[flip_x][flip_y][opaque];
+
+  if (width == 16 && height == 16)
+    return tile_draw_16x16[flip_x][flip_y][opaque];
+
+  return NULL;
+}
+
+void tile_draw(bitmap_t *bitmap, const tile_rom_t *rom, uint16_t code,
+               uint8_t color, uint16_t palette_offset, int x, int y, int width,
+               int height, bool flip_x, bool flip_y, uint8_t priority_mask,
+               uint8_t flags) {
+  tile_draw_fn_t draw = tile_draw_variant(width, height, flip_x, flip_y,
+                                          flags & TILE_OPAQUE);
+
+  if (draw) {
+    draw(bitmap, rom, code, color, palette_offset, x, y, priority_mask, flags);
+    return;
+  }
+
   /* bail out if the tile is completely off-screen */
   if (x < 0 - width - 1 || y < 0 - height - 1 || x >= bitmap->width ||
       y >= bitmap->height)
     return;
 
-  uint16_t *data = bitmap_data(bitmap, x, y);
-  uint8_t *priority = bitmap_priority(bitmap, x, y);
-  uint8_t *tile = rom + (code * width * height);
+  const uint8_t *tile = tile_rom_tile(rom, code);
 
   int flip_mask_x = flip_x ? (width - 1) : 0;
   int flip_mask_y = flip_y ? (height - 1) : 0;
@@ -116,11 +681,11 @@ void tile_draw(bitmap_t *bitmap, uint8_t *rom, uint16_t code, uint8_t color,
       if (x + u < 0 || x + u >= bitmap->width)
         continue;
 
-      int offset = (v * bitmap->width) + u;
+      int offset = ((y + v) * bitmap->width) + x + u;
       uint8_t pen = tile[(v ^ flip_mask_y) * width + (u ^ flip_mask_x)] & 0xf;
 
-      tile_draw_pixel(data + offset, priority + offset, priority_mask,
-                      palette_offset, color, pen, flags);
+      tile_draw_pixel(bitmap, offset, priority_mask, palette_offset, color,
+                      pen, flags);
     }
   }
 }
@@ -35,6 +35,7 @@
 
 #pragma once
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
@@ -83,6 +84,51 @@ typedef struct {
   int tile_size;
 } tile_decode_desc_t;
 
+/* the maximum size of a decoded tile (in bytes) */
+#define TILE_MAX_SIZE (32 * 32)
+
+/* the maximum number of ROM chips in a tile ROM */
+#define TILE_MAX_BANKS 4
+
+/* flags of a packed tile */
+#define TILE_BLANK 0x01 /* every pixel uses the transparent pen */
+#define TILE_SOLID 0x02 /* no pixel uses the transparent pen */
+
+/* decoding states of the tiles in a tile ROM */
+enum { TILE_UNDECODED, TILE_DECODING, TILE_DECODED };
+
+/* A decoded tile ROM. The tiles are either all decoded up front, or each tile
+ * is decoded from the ROM chips the first time it is drawn. */
+typedef struct {
+  /* the 8-bit pixel data of the tiles, this is only written to while a tile
+   * is decoded on demand. It is NULL if only the packed tiles are kept. */
+  const uint8_t *data;
+
+  /* the number of tiles, and the size of each decoded tile (in bytes) */
+  int count;
+  int tile_size;
+
+  /* the decoding state of each tile, or NULL if all the tiles have already
+   * been decoded */
+  _Atomic uint8_t *states;
+
+  /* the layout of the tiles, and the ROM chips they are decoded from */
+  const tile_decode_desc_t *desc;
+  const uint8_t *banks[TILE_MAX_BANKS];
+  int bank_size;
+
+  /* the tiles packed by tile_pack, and the flags of each tile, or NULL if
+   * the tiles aren't packed. They are packed as they are decoded. */
+  const uint8_t *packed;
+  int packed_size;
+  const uint8_t *tile_flags;
+
+  /* the tiles flipped horizontally, vertically, and both ways, one after the
+   * other for each tile, or NULL if the tiles aren't pre-flipped. They are
+   * flipped as they are decoded. */
+  const uint8_t *flipped;
+} tile_rom_t;
+
 /**
  * Decodes the given tile ROM to 8-bit pixel data.
  *
@@ -90,17 +136,142 @@ typedef struct {
  * advantage is that you don't have to jump around to get the pixel data. You
  * can just iterate through the pixels sequentially, as each pixel is
  * represented by only one byte.
+ *
+ * Tiles of packed 4-bit pixels, like the Rygar tiles, are decoded a whole
+ * byte at a time. Any other layout falls back to tile_decode_generic.
  */
 void tile_decode(const tile_decode_desc_t *desc,
-                 uint8_t *rom,
+                 const uint8_t *rom,
                  uint8_t *dst,
                  int count);
 
 /**
- * Draws the given tile to a bitmap.
+ * Decodes the given tile ROM like tile_decode, but reads each bit of every
+ * pixel separately, so it works with any layout.
+ */
+void tile_decode_generic(const tile_decode_desc_t *desc,
+                         const uint8_t *rom,
+                         uint8_t *dst,
+                         int count);
+
+/**
+ * Returns the size of a packed tile of the given dimensions (in bytes), or
+ * zero if tiles of that width can't be packed.
+ */
+int tile_packed_size(int width, int height);
+
+/**
+ * Packs a decoded tile to 4 bits per pixel, with the first pixel of each pair
+ * in the low nibble. The pixels are followed by a mask of the pixels in each
+ * row which don't use the transparent pen, where bit n is set for pixel n, and
+ * the TILE_BLANK and TILE_SOLID flags of the tile are set.
+ *
+ * A packed tile takes up less than two thirds of the space of a decoded tile,
+ * and lets blank tiles and rows be skipped, and solid rows be drawn without
+ * testing each pixel.
+ */
+void tile_pack(const uint8_t *tile, int width, int height, uint8_t *dst,
+               uint8_t *flags);
+
+/**
+ * Decodes the given tile of a tile ROM from its ROM chips to dst, which must
+ * be at least the size of a decoded tile.
+ */
+void tile_rom_decode_tile(const tile_rom_t *rom, int code, uint8_t *dst);
+
+/**
+ * Packs and flips all the tiles of a tile ROM, if it has packed or flipped
+ * tiles, from the given decoded tiles. If tiles is NULL, then each tile is
+ * decoded from the ROM chips first, so the decoded tiles needn't be kept.
+ *
+ * The tiles of a tile ROM which is decoded on demand are packed and flipped
+ * as they are decoded instead.
+ */
+void tile_rom_convert_all(const tile_rom_t *rom, const uint8_t *tiles);
+
+/**
+ * Flips a decoded tile horizontally, vertically, and both ways, and writes
+ * the three tiles one after the other.
+ */
+void tile_flip(const uint8_t *tile, int width, int height, uint8_t *dst);
+
+/**
+ * Decodes the given tile of a tile ROM which is decoded on demand. If another
+ * thread is already decoding the tile, then this waits for it to finish.
+ */
+void tile_rom_decode(const tile_rom_t *rom, int code);
+
+/**
+ * Decodes all the tiles of a tile ROM which haven't been decoded yet.
+ */
+void tile_rom_decode_all(const tile_rom_t *rom);
+
+/**
+ * Decodes the given tile if it hasn't been decoded yet.
+ */
+static inline void tile_rom_ensure_decoded(const tile_rom_t *rom, int code) {
+  if (rom->states && atomic_load_explicit(&rom->states[code],
+                                          memory_order_acquire) != TILE_DECODED)
+    tile_rom_decode(rom, code);
+}
+
+/**
+ * Returns the pixel data of the given tile, decoding it first if needed.
+ */
+static inline const uint8_t *tile_rom_tile(const tile_rom_t *rom, int code) {
+  tile_rom_ensure_decoded(rom, code);
+
+  return rom->data + code * rom->tile_size;
+}
+
+/**
+ * Returns the packed data of the given tile, decoding it first if needed.
+ */
+static inline const uint8_t *tile_rom_packed_tile(const tile_rom_t *rom,
+                                                  int code) {
+  tile_rom_ensure_decoded(rom, code);
+
+  return rom->packed + code * rom->packed_size;
+}
+
+/**
+ * Returns the pixel data of the given tile flipped in the given directions,
+ * which must not both be false, decoding it first if needed.
+ */
+static inline const uint8_t *tile_rom_flipped_tile(const tile_rom_t *rom,
+                                                   int code, bool flip_x,
+                                                   bool flip_y) {
+  tile_rom_ensure_decoded(rom, code);
+
+  return rom->flipped +
+         (code * 3 + (flip_y << 1 | flip_x) - 1) * rom->tile_size;
+}
+
+/* draws a tile of a fixed size, flipping, and opacity */
+typedef void (*tile_draw_fn_t)(bitmap_t *bitmap, const tile_rom_t *rom,
+                               uint16_t code, uint8_t color,
+                               uint16_t palette_offset, int x, int y,
+                               uint8_t priority_mask, uint8_t flags);
+
+/**
+ * Returns the variant of tile_draw which is specialised for the given tile
+ * size, flipping, and opacity, or NULL if there isn't one. There are variants
+ * for 8x8 and 16x16 tiles.
+ *
+ * The variants clip the tile to the bitmap once, rather than checking each
+ * pixel, so it is worth picking a variant once for a run of similar tiles.
+ * Flipped tiles are drawn forwards from the pre-flipped tiles if the tile ROM
+ * has them.
+ */
+tile_draw_fn_t tile_draw_variant(int width, int height, bool flip_x,
+                                 bool flip_y, bool opaque);
+
+/**
+ * Draws the given tile to a bitmap, with the specialised variant for the tile
+ * if there is one.
  */
 void tile_draw(bitmap_t *bitmap,
-               uint8_t *rom,
+               const tile_rom_t *rom,
                uint16_t code,
                uint8_t color,
                uint16_t palette_offset,
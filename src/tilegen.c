@@ -0,0 +1,78 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rygar.h"
+
+/* the number of bytes on each line */
+#define BYTES_PER_LINE 16
+
+/**
+ * Decodes the tile ROMs at build time, and writes them to the standard output
+ * as a C header. It is linked with a core which decodes the tile ROMs at
+ * runtime.
+ */
+int main(int argc, char *argv[]) {
+  uint8_t *tiles = malloc(TILE_ROMS_SIZE);
+
+  if (!tiles) {
+    fprintf(stderr, "couldn't allocate the tile roms\n");
+    return EXIT_FAILURE;
+  }
+
+  rygar_decode_tile_roms(tiles, false);
+
+  printf("// machine generated, don't edit!\n");
+  printf("static const unsigned char dump_tiles[%d] = {\n", TILE_ROMS_SIZE);
+
+  for (int i = 0; i < TILE_ROMS_SIZE; i++) {
+    if (i % BYTES_PER_LINE == 0) {
+      printf("  ");
+    }
+
+    printf("0x%02x,", tiles[i]);
+
+    if (i % BYTES_PER_LINE == BYTES_PER_LINE - 1) {
+      printf("\n");
+    }
+  }
+
+  printf("};\n");
+  free(tiles);
+
+  return ferror(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
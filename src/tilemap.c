@@ -58,6 +58,27 @@ void tilemap_mark_tile_dirty(tilemap_t *tilemap, const int index) {
   tilemap->tiles[index].flags |= TILEMAP_TILE_DIRTY;
 }
 
+void tilemap_mark_all_dirty(tilemap_t *tilemap) {
+  for (int i = 0; i < tilemap->rows * tilemap->cols; i++) {
+    tilemap->tiles[i].flags |= TILEMAP_TILE_DIRTY;
+  }
+}
+
+void tilemap_mark_colors_dirty(tilemap_t *tilemap, uint16_t colors) {
+  if (!colors)
+    return;
+
+  for (int i = 0; i < tilemap->rows * tilemap->cols; i++) {
+    if (colors & (1 << tilemap->tiles[i].color)) {
+      tilemap->tiles[i].flags |= TILEMAP_TILE_DIRTY;
+    }
+  }
+}
+
+void tilemap_set_palette(tilemap_t *tilemap, const uint32_t *palette) {
+  bitmap_set_palette(&tilemap->bitmap, palette);
+}
+
 void tilemap_set_scroll_x(tilemap_t *tilemap, const uint16_t value) {
   tilemap->scroll_x = value;
 }
@@ -72,6 +93,10 @@ void tilemap_draw(tilemap_t *tilemap, bitmap_t *bitmap, uint16_t palette_offset,
    * through any transparent parts of the tile */
   flags |= TILE_OPAQUE;
 
+  tile_draw_fn_t draw =
+      tile_draw_variant(tilemap->tile_width, tilemap->tile_height, false,
+                        false, true);
+
   for (int row = 0; row < tilemap->rows; row++) {
     for (int col = 0; col < tilemap->cols; col++) {
       int index = (row * tilemap->cols) + col;
@@ -83,12 +108,16 @@ void tilemap_draw(tilemap_t *tilemap, bitmap_t *bitmap, uint16_t palette_offset,
         int x = col * tilemap->tile_width;
         int y = row * tilemap->tile_height;
 
-        tile_draw(&tilemap->bitmap, tilemap->rom, tile->code, tile->color,
-                  palette_offset, x, y, tilemap->tile_width,
-                  tilemap->tile_height, false, false,
-                  0, /* don't bother masking, as we're only rendering to the
-                        internal buffer */
-                  flags);
+        /* don't bother masking, as we're only rendering to the internal
+         * buffer */
+        if (draw) {
+          draw(&tilemap->bitmap, tilemap->rom, tile->code, tile->color,
+               palette_offset, x, y, 0, flags);
+        } else {
+          tile_draw(&tilemap->bitmap, tilemap->rom, tile->code, tile->color,
+                    palette_offset, x, y, tilemap->tile_width,
+                    tilemap->tile_height, false, false, 0, flags);
+        }
 
         tile->flags ^= TILEMAP_TILE_DIRTY;
       }
@@ -58,7 +58,7 @@ typedef struct {
 /* descriptor for initialising a tilemap */
 typedef struct {
   uint8_t *ram;
-  uint8_t *rom;
+  const tile_rom_t *rom;
 
   /* dimensions */
   int tile_width;
@@ -73,7 +73,7 @@ typedef struct {
 /* the tilemap */
 typedef struct {
   uint8_t *ram;
-  uint8_t *rom;
+  const tile_rom_t *rom;
 
   /* dimensions */
   int tile_width;
@@ -110,6 +110,26 @@ void tilemap_shutdown(tilemap_t *tilemap);
  */
 void tilemap_mark_tile_dirty(tilemap_t *tilemap, const int index);
 
+/**
+ * Marks all the tiles as dirty, so the whole tilemap is redrawn.
+ */
+void tilemap_mark_all_dirty(tilemap_t *tilemap);
+
+/**
+ * Marks the tiles which use any of the given colors as dirty, where bit n of
+ * the colors is set for color n.
+ */
+void tilemap_mark_colors_dirty(tilemap_t *tilemap, uint16_t colors);
+
+/**
+ * Keeps the tilemap as 32-bit colors resolved through the palette, as well as
+ * pens, or only as pens if the palette is NULL.
+ *
+ * The colors of a tile are only resolved when it is redrawn, so the tiles must
+ * be marked dirty when the colors they use are changed in the palette.
+ */
+void tilemap_set_palette(tilemap_t *tilemap, const uint32_t *palette);
+
 /**
  * Sets the horizontal scroll offset.
  */
@@ -0,0 +1,1298 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "z80step.h"
+
+/* operand index for (HL), (IX+d) and (IY+d) */
+#define R_HL 6
+
+/* operand index for A */
+#define R_A 7
+
+/* reads a byte from memory */
+static inline uint8_t rd(const z80_bus_t *bus, uint16_t addr) {
+  if (bus->direct_read & (1ULL << (addr >> MEM_PAGE_SHIFT))) {
+    return mem_rd(bus->mem, addr);
+  }
+
+  return bus->mem_read(bus->user_data, addr);
+}
+
+/* writes a byte to memory */
+static inline void wr(const z80_bus_t *bus, uint16_t addr, uint8_t data) {
+  if (bus->direct_write & (1ULL << (addr >> MEM_PAGE_SHIFT))) {
+    mem_wr(bus->mem, addr, data);
+  } else {
+    bus->mem_write(bus->user_data, addr, data);
+  }
+}
+
+/* reads a 16-bit little-endian value from memory */
+static inline uint16_t rd16(const z80_bus_t *bus, uint16_t addr) {
+  uint8_t lo = rd(bus, addr);
+  uint8_t hi = rd(bus, addr + 1);
+  return hi << 8 | lo;
+}
+
+/* writes a 16-bit little-endian value to memory */
+static inline void wr16(const z80_bus_t *bus, uint16_t addr, uint16_t data) {
+  wr(bus, addr, data & 0xff);
+  wr(bus, addr + 1, data >> 8);
+}
+
+/* fetches an opcode byte in an M1 cycle, which also bumps the refresh
+ * register */
+static inline uint8_t fetch(z80_t *cpu, const z80_bus_t *bus) {
+  cpu->r = (cpu->r & 0x80) | ((cpu->r + 1) & 0x7f);
+  return rd(bus, cpu->pc++);
+}
+
+/* reads an immediate byte */
+static inline uint8_t imm8(z80_t *cpu, const z80_bus_t *bus) {
+  return rd(bus, cpu->pc++);
+}
+
+/* reads an immediate 16-bit value */
+static inline uint16_t imm16(z80_t *cpu, const z80_bus_t *bus) {
+  uint16_t data = rd16(bus, cpu->pc);
+  cpu->pc += 2;
+  return data;
+}
+
+static inline void push(z80_t *cpu, const z80_bus_t *bus, uint16_t data) {
+  wr(bus, --cpu->sp, data >> 8);
+  wr(bus, --cpu->sp, data & 0xff);
+}
+
+static inline uint16_t pop(z80_t *cpu, const z80_bus_t *bus) {
+  uint8_t lo = rd(bus, cpu->sp++);
+  uint8_t hi = rd(bus, cpu->sp++);
+  return hi << 8 | lo;
+}
+
+/*
+ * Flags
+ */
+
+static inline uint8_t sz_flags(uint8_t val) {
+  return val ? (val & Z80_SF) : Z80_ZF;
+}
+
+static inline uint8_t szp_flags(uint8_t val) {
+  uint8_t f = sz_flags(val) | (val & (Z80_YF | Z80_XF));
+  return __builtin_parity(val) ? f : f | Z80_PF;
+}
+
+static inline uint8_t szyxch_flags(uint8_t acc, uint8_t val, uint32_t res) {
+  return sz_flags(res) | (res & (Z80_YF | Z80_XF)) | ((res >> 8) & Z80_CF) |
+         ((acc ^ val ^ res) & Z80_HF);
+}
+
+static inline uint8_t add_flags(uint8_t acc, uint8_t val, uint32_t res) {
+  return szyxch_flags(acc, val, res) |
+         ((((val ^ acc ^ 0x80) & (val ^ res)) >> 5) & Z80_VF);
+}
+
+static inline uint8_t sub_flags(uint8_t acc, uint8_t val, uint32_t res) {
+  return Z80_NF | szyxch_flags(acc, val, res) |
+         ((((val ^ acc) & (res ^ acc)) >> 5) & Z80_VF);
+}
+
+static inline uint8_t cp_flags(uint8_t acc, uint8_t val, uint32_t res) {
+  return Z80_NF | sz_flags(res) | (val & (Z80_YF | Z80_XF)) |
+         ((res >> 8) & Z80_CF) | ((acc ^ val ^ res) & Z80_HF) |
+         ((((val ^ acc) & (res ^ acc)) >> 5) & Z80_VF);
+}
+
+static inline uint8_t sziff2_flags(z80_t *cpu, uint8_t val) {
+  return (cpu->f & Z80_CF) | sz_flags(val) | (val & (Z80_YF | Z80_XF)) |
+         (cpu->iff2 ? Z80_PF : 0);
+}
+
+/*
+ * 8-bit arithmetic and logic
+ */
+
+/* performs one of the eight accumulator operations (ADD, ADC, SUB, SBC, AND,
+ * XOR, OR, CP), as encoded in bits 3-5 of the opcode */
+static inline void alu8(z80_t *cpu, int op, uint8_t val) {
+  uint8_t acc = cpu->a;
+  uint32_t res;
+
+  switch (op) {
+  case 0:
+    res = acc + val;
+    cpu->f = add_flags(acc, val, res);
+    cpu->a = res;
+    break;
+  case 1:
+    res = acc + val + (cpu->f & Z80_CF);
+    cpu->f = add_flags(acc, val, res);
+    cpu->a = res;
+    break;
+  case 2:
+    res = (uint32_t)((int)acc - (int)val);
+    cpu->f = sub_flags(acc, val, res);
+    cpu->a = res;
+    break;
+  case 3:
+    res = (uint32_t)((int)acc - (int)val - (cpu->f & Z80_CF));
+    cpu->f = sub_flags(acc, val, res);
+    cpu->a = res;
+    break;
+  case 4:
+    cpu->a &= val;
+    cpu->f = szp_flags(cpu->a) | Z80_HF;
+    break;
+  case 5:
+    cpu->a ^= val;
+    cpu->f = szp_flags(cpu->a);
+    break;
+  case 6:
+    cpu->a |= val;
+    cpu->f = szp_flags(cpu->a);
+    break;
+  default:
+    res = (uint32_t)((int)acc - (int)val);
+    cpu->f = cp_flags(acc, val, res);
+    break;
+  }
+}
+
+static inline uint8_t inc8(z80_t *cpu, uint8_t val) {
+  uint8_t res = val + 1;
+  uint8_t f =
+      sz_flags(res) | (res & (Z80_XF | Z80_YF)) | ((res ^ val) & Z80_HF);
+
+  if (res == 0x80) {
+    f |= Z80_VF;
+  }
+
+  cpu->f = f | (cpu->f & Z80_CF);
+  return res;
+}
+
+static inline uint8_t dec8(z80_t *cpu, uint8_t val) {
+  uint8_t res = val - 1;
+  uint8_t f = Z80_NF | sz_flags(res) | (res & (Z80_XF | Z80_YF)) |
+              ((res ^ val) & Z80_HF);
+
+  if (res == 0x7f) {
+    f |= Z80_VF;
+  }
+
+  cpu->f = f | (cpu->f & Z80_CF);
+  return res;
+}
+
+static inline void daa(z80_t *cpu) {
+  uint8_t res = cpu->a;
+
+  if (cpu->f & Z80_NF) {
+    if (((cpu->a & 0xf) > 0x9) || (cpu->f & Z80_HF)) {
+      res -= 0x06;
+    }
+    if ((cpu->a > 0x99) || (cpu->f & Z80_CF)) {
+      res -= 0x60;
+    }
+  } else {
+    if (((cpu->a & 0xf) > 0x9) || (cpu->f & Z80_HF)) {
+      res += 0x06;
+    }
+    if ((cpu->a > 0x99) || (cpu->f & Z80_CF)) {
+      res += 0x60;
+    }
+  }
+
+  cpu->f &= Z80_CF | Z80_NF;
+  cpu->f |= (cpu->a > 0x99) ? Z80_CF : 0;
+  cpu->f |= (cpu->a ^ res) & Z80_HF;
+  cpu->f |= szp_flags(res);
+  cpu->a = res;
+}
+
+/* performs one of the eight rotate/shift operations (RLC, RRC, RL, RR, SLA,
+ * SRA, SLL, SRL), as encoded in bits 3-5 of a CB-prefixed opcode */
+static inline uint8_t rot8(z80_t *cpu, int op, uint8_t val) {
+  uint8_t res;
+  uint8_t carry;
+
+  switch (op) {
+  case 0:
+    res = (val << 1) | (val >> 7);
+    carry = val >> 7;
+    break;
+  case 1:
+    res = (val >> 1) | (val << 7);
+    carry = val & 1;
+    break;
+  case 2:
+    res = (val << 1) | (cpu->f & Z80_CF);
+    carry = val >> 7;
+    break;
+  case 3:
+    res = (val >> 1) | ((cpu->f & Z80_CF) << 7);
+    carry = val & 1;
+    break;
+  case 4:
+    res = val << 1;
+    carry = val >> 7;
+    break;
+  case 5:
+    res = (val >> 1) | (val & 0x80);
+    carry = val & 1;
+    break;
+  case 6:
+    res = (val << 1) | 1;
+    carry = val >> 7;
+    break;
+  default:
+    res = val >> 1;
+    carry = val & 1;
+    break;
+  }
+
+  cpu->f = szp_flags(res) | carry;
+  return res;
+}
+
+/* performs a CB-prefixed operation on a value, and returns the result; the
+ * flags for BIT take the undocumented bits from the given value */
+static inline uint8_t cb8(z80_t *cpu, uint8_t op, uint8_t val, uint8_t xy) {
+  int y = (op >> 3) & 7;
+
+  switch (op >> 6) {
+  case 0:
+    return rot8(cpu, y, val);
+  case 1: {
+    uint8_t res = val & (1 << y);
+    cpu->f = (cpu->f & Z80_CF) | Z80_HF |
+             (res ? (res & Z80_SF) : (Z80_ZF | Z80_PF)) |
+             (xy & (Z80_YF | Z80_XF));
+    return val;
+  }
+  case 2:
+    return val & ~(1 << y);
+  default:
+    return val | (1 << y);
+  }
+}
+
+/*
+ * 16-bit arithmetic
+ */
+
+static inline uint16_t add16(z80_t *cpu, uint16_t acc, uint16_t val) {
+  uint32_t res = acc + val;
+  cpu->wz = acc + 1;
+  cpu->f = (cpu->f & (Z80_SF | Z80_ZF | Z80_VF)) |
+           (((acc ^ res ^ val) >> 8) & Z80_HF) | ((res >> 16) & Z80_CF) |
+           ((res >> 8) & (Z80_YF | Z80_XF));
+  return res;
+}
+
+static inline void adc16(z80_t *cpu, uint16_t val) {
+  uint16_t acc = cpu->hl;
+  uint32_t res = acc + val + (cpu->f & Z80_CF);
+  cpu->wz = acc + 1;
+  cpu->hl = res;
+  cpu->f = (((val ^ acc ^ 0x8000) & (val ^ res) & 0x8000) >> 13) |
+           (((acc ^ res ^ val) >> 8) & Z80_HF) | ((res >> 16) & Z80_CF) |
+           ((res >> 8) & (Z80_SF | Z80_YF | Z80_XF)) |
+           ((res & 0xffff) ? 0 : Z80_ZF);
+}
+
+static inline void sbc16(z80_t *cpu, uint16_t val) {
+  uint16_t acc = cpu->hl;
+  uint32_t res = acc - val - (cpu->f & Z80_CF);
+  cpu->wz = acc + 1;
+  cpu->hl = res;
+  cpu->f = (Z80_NF | (((val ^ acc) & (acc ^ res) & 0x8000) >> 13)) |
+           (((acc ^ res ^ val) >> 8) & Z80_HF) | ((res >> 16) & Z80_CF) |
+           ((res >> 8) & (Z80_SF | Z80_YF | Z80_XF)) |
+           ((res & 0xffff) ? 0 : Z80_ZF);
+}
+
+/*
+ * Block transfers
+ */
+
+static inline bool ldi_ldd(z80_t *cpu, uint8_t val) {
+  uint8_t res = cpu->a + val;
+  cpu->bc -= 1;
+  cpu->f = (cpu->f & (Z80_SF | Z80_ZF | Z80_CF)) | ((res & 2) ? Z80_YF : 0) |
+           ((res & 8) ? Z80_XF : 0) | (cpu->bc ? Z80_VF : 0);
+  return cpu->bc != 0;
+}
+
+static inline bool cpi_cpd(z80_t *cpu, uint8_t val) {
+  uint32_t res = (uint32_t)((int)cpu->a - (int)val);
+  uint8_t f = (cpu->f & Z80_CF) | Z80_NF | sz_flags(res);
+
+  cpu->bc -= 1;
+
+  if ((res & 0xf) > ((uint32_t)cpu->a & 0xf)) {
+    f |= Z80_HF;
+    res--;
+  }
+
+  if (res & 2) {
+    f |= Z80_YF;
+  }
+
+  if (res & 8) {
+    f |= Z80_XF;
+  }
+
+  if (cpu->bc) {
+    f |= Z80_VF;
+  }
+
+  cpu->f = f;
+  return (cpu->bc != 0) && !(f & Z80_ZF);
+}
+
+/* sets the flags for INI/IND/OUTI/OUTD, where k is the low byte of the port
+ * or memory address added to the transferred value */
+static inline bool io_block_flags(z80_t *cpu, uint8_t val, uint8_t k) {
+  uint8_t b = cpu->b;
+  uint8_t f = sz_flags(b) | (b & (Z80_XF | Z80_YF));
+  uint32_t t = (uint32_t)k + val;
+
+  if (val & Z80_SF) {
+    f |= Z80_NF;
+  }
+
+  if (t & 0x100) {
+    f |= Z80_HF | Z80_CF;
+  }
+
+  f |= szp_flags(((uint8_t)(t & 7)) ^ b) & Z80_PF;
+  cpu->f = f;
+  return b != 0;
+}
+
+/*
+ * Operands
+ */
+
+/* returns one of the 8-bit registers B, C, D, E, H, L or A, where H and L
+ * are replaced by the halves of IX or IY for DD/FD-prefixed instructions */
+static inline uint8_t get_r(z80_t *cpu, int r, int idx) {
+  switch (r) {
+  case 0:
+    return cpu->b;
+  case 1:
+    return cpu->c;
+  case 2:
+    return cpu->d;
+  case 3:
+    return cpu->e;
+  case 4:
+    return cpu->hlx[idx].h;
+  case 5:
+    return cpu->hlx[idx].l;
+  default:
+    return cpu->a;
+  }
+}
+
+static inline void set_r(z80_t *cpu, int r, int idx, uint8_t val) {
+  switch (r) {
+  case 0:
+    cpu->b = val;
+    break;
+  case 1:
+    cpu->c = val;
+    break;
+  case 2:
+    cpu->d = val;
+    break;
+  case 3:
+    cpu->e = val;
+    break;
+  case 4:
+    cpu->hlx[idx].h = val;
+    break;
+  case 5:
+    cpu->hlx[idx].l = val;
+    break;
+  default:
+    cpu->a = val;
+    break;
+  }
+}
+
+/* returns one of the register pairs BC, DE, HL (or IX/IY) or SP */
+static inline uint16_t get_rp(z80_t *cpu, int p, int idx) {
+  switch (p) {
+  case 0:
+    return cpu->bc;
+  case 1:
+    return cpu->de;
+  case 2:
+    return cpu->hlx[idx].hl;
+  default:
+    return cpu->sp;
+  }
+}
+
+static inline void set_rp(z80_t *cpu, int p, int idx, uint16_t val) {
+  switch (p) {
+  case 0:
+    cpu->bc = val;
+    break;
+  case 1:
+    cpu->de = val;
+    break;
+  case 2:
+    cpu->hlx[idx].hl = val;
+    break;
+  default:
+    cpu->sp = val;
+    break;
+  }
+}
+
+/* returns one of the register pairs BC, DE, HL (or IX/IY) or AF, as used by
+ * PUSH and POP */
+static inline uint16_t get_rp2(z80_t *cpu, int p, int idx) {
+  return p == 3 ? cpu->af : get_rp(cpu, p, idx);
+}
+
+static inline void set_rp2(z80_t *cpu, int p, int idx, uint16_t val) {
+  if (p == 3) {
+    cpu->af = val;
+  } else {
+    set_rp(cpu, p, idx, val);
+  }
+}
+
+/* tests one of the conditions NZ, Z, NC, C, PO, PE, P or M */
+static inline bool cond(z80_t *cpu, int cc) {
+  switch (cc) {
+  case 0:
+    return !(cpu->f & Z80_ZF);
+  case 1:
+    return cpu->f & Z80_ZF;
+  case 2:
+    return !(cpu->f & Z80_CF);
+  case 3:
+    return cpu->f & Z80_CF;
+  case 4:
+    return !(cpu->f & Z80_PF);
+  case 5:
+    return cpu->f & Z80_PF;
+  case 6:
+    return !(cpu->f & Z80_SF);
+  default:
+    return cpu->f & Z80_SF;
+  }
+}
+
+/* returns the effective address of a (HL), (IX+d) or (IY+d) operand */
+static inline uint16_t hl_addr(z80_t *cpu, const z80_bus_t *bus, int idx) {
+  if (idx == 0)
+    return cpu->hl;
+
+  uint16_t addr = cpu->hlx[idx].hl + (int8_t)imm8(cpu, bus);
+  cpu->wz = addr;
+  return addr;
+}
+
+/*
+ * Instructions
+ */
+
+/* executes a CB-prefixed instruction */
+static int exec_cb(z80_t *cpu, const z80_bus_t *bus, uint8_t op) {
+  int z = op & 7;
+
+  if (z == R_HL) {
+    uint8_t val = rd(bus, cpu->hl);
+    uint8_t res = cb8(cpu, op, val, cpu->wz >> 8);
+
+    if ((op >> 6) == 1)
+      return 12;
+
+    wr(bus, cpu->hl, res);
+    return 15;
+  }
+
+  uint8_t val = get_r(cpu, z, 0);
+  uint8_t res = cb8(cpu, op, val, val);
+
+  if ((op >> 6) != 1) {
+    set_r(cpu, z, 0, res);
+  }
+
+  return 8;
+}
+
+/* executes a DD+CB or FD+CB prefixed instruction, the result of which is also
+ * copied to a register for the undocumented variants */
+static int exec_ddfdcb(z80_t *cpu, const z80_bus_t *bus, int idx) {
+  uint16_t addr = cpu->hlx[idx].hl + (int8_t)imm8(cpu, bus);
+  uint8_t op = imm8(cpu, bus);
+  int z = op & 7;
+
+  cpu->wz = addr;
+
+  uint8_t val = rd(bus, addr);
+  uint8_t res = cb8(cpu, op, val, addr >> 8);
+
+  if ((op >> 6) == 1)
+    return 16;
+
+  wr(bus, addr, res);
+
+  if (z != R_HL) {
+    set_r(cpu, z, 0, res);
+  }
+
+  return 19;
+}
+
+/* executes an ED-prefixed instruction */
+static int exec_ed(z80_t *cpu, const z80_bus_t *bus, uint8_t op) {
+  int y = (op >> 3) & 7;
+  int p = y >> 1;
+
+  if (op >= 0x40 && op < 0x80) {
+    switch (op & 7) {
+    case 0: {
+      /* IN r,(C) */
+      uint8_t val = bus->io_read(bus->user_data, cpu->bc);
+      cpu->wz = cpu->bc + 1;
+      cpu->f = (cpu->f & Z80_CF) | szp_flags(val);
+
+      if (y != R_HL) {
+        set_r(cpu, y, 0, val);
+      }
+
+      return 12;
+    }
+    case 1:
+      /* OUT (C),r */
+      bus->io_write(bus->user_data, cpu->bc, y == R_HL ? 0 : get_r(cpu, y, 0));
+      cpu->wz = cpu->bc + 1;
+      return 12;
+    case 2:
+      /* SBC HL,rr / ADC HL,rr */
+      if (y & 1) {
+        adc16(cpu, get_rp(cpu, p, 0));
+      } else {
+        sbc16(cpu, get_rp(cpu, p, 0));
+      }
+      return 15;
+    case 3: {
+      /* LD (nn),rr / LD rr,(nn) */
+      uint16_t addr = imm16(cpu, bus);
+
+      if (y & 1) {
+        set_rp(cpu, p, 0, rd16(bus, addr));
+      } else {
+        wr16(bus, addr, get_rp(cpu, p, 0));
+      }
+
+      cpu->wz = addr + 1;
+      return 20;
+    }
+    case 4: {
+      /* NEG */
+      uint8_t val = cpu->a;
+      uint32_t res = (uint32_t)(0 - (int)val);
+      cpu->f = sub_flags(0, val, res);
+      cpu->a = res;
+      return 8;
+    }
+    case 5:
+      /* RETN / RETI */
+      cpu->wz = cpu->pc = pop(cpu, bus);
+      cpu->iff1 = cpu->iff2;
+      return 14;
+    case 6:
+      /* IM 0 / IM 1 / IM 2 */
+      cpu->im = (y & 3) ? (y & 3) - 1 : 0;
+      return 8;
+    default:
+      switch (y) {
+      case 0:
+        /* LD I,A */
+        cpu->i = cpu->a;
+        return 9;
+      case 1:
+        /* LD R,A */
+        cpu->r = cpu->a;
+        return 9;
+      case 2:
+        /* LD A,I */
+        cpu->a = cpu->i;
+        cpu->f = sziff2_flags(cpu, cpu->i);
+        return 9;
+      case 3:
+        /* LD A,R */
+        cpu->a = cpu->r;
+        cpu->f = sziff2_flags(cpu, cpu->r);
+        return 9;
+      case 4: {
+        /* RRD */
+        uint8_t val = rd(bus, cpu->hl);
+        uint8_t l = cpu->a & 0x0f;
+        cpu->a = (cpu->a & 0xf0) | (val & 0x0f);
+        wr(bus, cpu->hl, (val >> 4) | (l << 4));
+        cpu->f = (cpu->f & Z80_CF) | szp_flags(cpu->a);
+        cpu->wz = cpu->hl + 1;
+        return 18;
+      }
+      case 5: {
+        /* RLD */
+        uint8_t val = rd(bus, cpu->hl);
+        uint8_t l = cpu->a & 0x0f;
+        cpu->a = (cpu->a & 0xf0) | (val >> 4);
+        wr(bus, cpu->hl, (val << 4) | l);
+        cpu->f = (cpu->f & Z80_CF) | szp_flags(cpu->a);
+        cpu->wz = cpu->hl + 1;
+        return 18;
+      }
+      default:
+        return 8;
+      }
+    }
+  }
+
+  if (op < 0xa0 || op >= 0xc0 || (op & 7) > 3)
+    return 8;
+
+  /* block instructions, with bit 3 selecting decrement and bit 4 repeat */
+  int dir = (op & 0x08) ? -1 : 1;
+  bool repeat = op & 0x10;
+  bool again;
+
+  switch (op & 3) {
+  case 0: {
+    /* LDI / LDD / LDIR / LDDR */
+    uint8_t val = rd(bus, cpu->hl);
+    wr(bus, cpu->de, val);
+    cpu->hl += dir;
+    cpu->de += dir;
+    again = ldi_ldd(cpu, val);
+    break;
+  }
+  case 1: {
+    /* CPI / CPD / CPIR / CPDR */
+    uint8_t val = rd(bus, cpu->hl);
+    cpu->hl += dir;
+    cpu->wz += dir;
+    again = cpi_cpd(cpu, val);
+    break;
+  }
+  case 2: {
+    /* INI / IND / INIR / INDR */
+    uint8_t val = bus->io_read(bus->user_data, cpu->bc);
+    cpu->wz = cpu->bc + dir;
+    cpu->b--;
+    wr(bus, cpu->hl, val);
+    cpu->hl += dir;
+    again = io_block_flags(cpu, val, cpu->c + dir);
+    break;
+  }
+  default: {
+    /* OUTI / OUTD / OTIR / OTDR */
+    uint8_t val = rd(bus, cpu->hl);
+    cpu->hl += dir;
+    cpu->b--;
+    bus->io_write(bus->user_data, cpu->bc, val);
+    cpu->wz = cpu->bc + dir;
+    again = io_block_flags(cpu, val, cpu->l);
+    break;
+  }
+  }
+
+  if (repeat && again) {
+    cpu->wz = --cpu->pc;
+    --cpu->pc;
+    return 21;
+  }
+
+  return 16;
+}
+
+/* executes an unprefixed instruction, or the payload of a DD/FD-prefixed
+ * instruction (where idx selects IX or IY in place of HL) */
+static int exec(z80_t *cpu, const z80_bus_t *bus, uint8_t op, int idx) {
+  int y = (op >> 3) & 7;
+  int z = op & 7;
+  int p = y >> 1;
+
+  /* LD r,r' */
+  if (op >= 0x40 && op < 0x80) {
+    if (op == 0x76) {
+      /* HALT */
+      cpu->pins |= Z80_STEP_HALT;
+      cpu->pc--;
+      return 4;
+    }
+
+    if (z == R_HL) {
+      uint16_t addr = hl_addr(cpu, bus, idx);
+      set_r(cpu, y, 0, rd(bus, addr));
+      return idx ? 15 : 7;
+    }
+
+    if (y == R_HL) {
+      uint16_t addr = hl_addr(cpu, bus, idx);
+      wr(bus, addr, get_r(cpu, z, 0));
+      return idx ? 15 : 7;
+    }
+
+    set_r(cpu, y, idx, get_r(cpu, z, idx));
+    return 4;
+  }
+
+  /* ALU A,r */
+  if (op >= 0x80 && op < 0xc0) {
+    if (z == R_HL) {
+      alu8(cpu, y, rd(bus, hl_addr(cpu, bus, idx)));
+      return idx ? 15 : 7;
+    }
+
+    alu8(cpu, y, get_r(cpu, z, idx));
+    return 4;
+  }
+
+  switch (op) {
+  case 0x00:
+    /* NOP */
+    return 4;
+
+  case 0x01:
+  case 0x11:
+  case 0x21:
+  case 0x31:
+    /* LD rr,nn */
+    set_rp(cpu, p, idx, imm16(cpu, bus));
+    return 10;
+
+  case 0x02:
+  case 0x12: {
+    /* LD (BC),A / LD (DE),A */
+    uint16_t addr = p ? cpu->de : cpu->bc;
+    wr(bus, addr, cpu->a);
+    cpu->wz = (cpu->a << 8) | ((addr + 1) & 0xff);
+    return 7;
+  }
+
+  case 0x0a:
+  case 0x1a: {
+    /* LD A,(BC) / LD A,(DE) */
+    uint16_t addr = p ? cpu->de : cpu->bc;
+    cpu->a = rd(bus, addr);
+    cpu->wz = addr + 1;
+    return 7;
+  }
+
+  case 0x22: {
+    /* LD (nn),HL */
+    uint16_t addr = imm16(cpu, bus);
+    wr16(bus, addr, cpu->hlx[idx].hl);
+    cpu->wz = addr + 1;
+    return 16;
+  }
+
+  case 0x2a: {
+    /* LD HL,(nn) */
+    uint16_t addr = imm16(cpu, bus);
+    cpu->hlx[idx].hl = rd16(bus, addr);
+    cpu->wz = addr + 1;
+    return 16;
+  }
+
+  case 0x32: {
+    /* LD (nn),A */
+    uint16_t addr = imm16(cpu, bus);
+    wr(bus, addr, cpu->a);
+    cpu->wz = (cpu->a << 8) | ((addr + 1) & 0xff);
+    return 13;
+  }
+
+  case 0x3a: {
+    /* LD A,(nn) */
+    uint16_t addr = imm16(cpu, bus);
+    cpu->a = rd(bus, addr);
+    cpu->wz = addr + 1;
+    return 13;
+  }
+
+  case 0x03:
+  case 0x13:
+  case 0x23:
+  case 0x33:
+    /* INC rr */
+    set_rp(cpu, p, idx, get_rp(cpu, p, idx) + 1);
+    return 6;
+
+  case 0x0b:
+  case 0x1b:
+  case 0x2b:
+  case 0x3b:
+    /* DEC rr */
+    set_rp(cpu, p, idx, get_rp(cpu, p, idx) - 1);
+    return 6;
+
+  case 0x04:
+  case 0x0c:
+  case 0x14:
+  case 0x1c:
+  case 0x24:
+  case 0x2c:
+  case 0x3c:
+    /* INC r */
+    set_r(cpu, y, idx, inc8(cpu, get_r(cpu, y, idx)));
+    return 4;
+
+  case 0x05:
+  case 0x0d:
+  case 0x15:
+  case 0x1d:
+  case 0x25:
+  case 0x2d:
+  case 0x3d:
+    /* DEC r */
+    set_r(cpu, y, idx, dec8(cpu, get_r(cpu, y, idx)));
+    return 4;
+
+  case 0x34: {
+    /* INC (HL) */
+    uint16_t addr = hl_addr(cpu, bus, idx);
+    wr(bus, addr, inc8(cpu, rd(bus, addr)));
+    return idx ? 19 : 11;
+  }
+
+  case 0x35: {
+    /* DEC (HL) */
+    uint16_t addr = hl_addr(cpu, bus, idx);
+    wr(bus, addr, dec8(cpu, rd(bus, addr)));
+    return idx ? 19 : 11;
+  }
+
+  case 0x06:
+  case 0x0e:
+  case 0x16:
+  case 0x1e:
+  case 0x26:
+  case 0x2e:
+  case 0x3e:
+    /* LD r,n */
+    set_r(cpu, y, idx, imm8(cpu, bus));
+    return 7;
+
+  case 0x36: {
+    /* LD (HL),n */
+    uint16_t addr = hl_addr(cpu, bus, idx);
+    wr(bus, addr, imm8(cpu, bus));
+    return idx ? 15 : 10;
+  }
+
+  case 0x07: {
+    /* RLCA */
+    uint8_t res = (cpu->a << 1) | (cpu->a >> 7);
+    cpu->f = ((cpu->a >> 7) & Z80_CF) |
+             (cpu->f & (Z80_SF | Z80_ZF | Z80_PF)) |
+             (res & (Z80_YF | Z80_XF));
+    cpu->a = res;
+    return 4;
+  }
+
+  case 0x0f: {
+    /* RRCA */
+    uint8_t res = (cpu->a >> 1) | (cpu->a << 7);
+    cpu->f = (cpu->a & Z80_CF) | (cpu->f & (Z80_SF | Z80_ZF | Z80_PF)) |
+             (res & (Z80_YF | Z80_XF));
+    cpu->a = res;
+    return 4;
+  }
+
+  case 0x17: {
+    /* RLA */
+    uint8_t res = (cpu->a << 1) | (cpu->f & Z80_CF);
+    cpu->f = ((cpu->a >> 7) & Z80_CF) |
+             (cpu->f & (Z80_SF | Z80_ZF | Z80_PF)) |
+             (res & (Z80_YF | Z80_XF));
+    cpu->a = res;
+    return 4;
+  }
+
+  case 0x1f: {
+    /* RRA */
+    uint8_t res = (cpu->a >> 1) | ((cpu->f & Z80_CF) << 7);
+    cpu->f = (cpu->a & Z80_CF) | (cpu->f & (Z80_SF | Z80_ZF | Z80_PF)) |
+             (res & (Z80_YF | Z80_XF));
+    cpu->a = res;
+    return 4;
+  }
+
+  case 0x08: {
+    /* EX AF,AF' */
+    uint16_t tmp = cpu->af2;
+    cpu->af2 = cpu->af;
+    cpu->af = tmp;
+    return 4;
+  }
+
+  case 0x09:
+  case 0x19:
+  case 0x29:
+  case 0x39:
+    /* ADD HL,rr */
+    cpu->hlx[idx].hl = add16(cpu, cpu->hlx[idx].hl, get_rp(cpu, p, idx));
+    return 11;
+
+  case 0x10: {
+    /* DJNZ d */
+    int8_t d = imm8(cpu, bus);
+
+    if (--cpu->b) {
+      cpu->wz = cpu->pc += d;
+      return 13;
+    }
+
+    return 8;
+  }
+
+  case 0x18: {
+    /* JR d */
+    int8_t d = imm8(cpu, bus);
+    cpu->wz = cpu->pc += d;
+    return 12;
+  }
+
+  case 0x20:
+  case 0x28:
+  case 0x30:
+  case 0x38: {
+    /* JR cc,d */
+    int8_t d = imm8(cpu, bus);
+
+    if (cond(cpu, y - 4)) {
+      cpu->wz = cpu->pc += d;
+      return 12;
+    }
+
+    return 7;
+  }
+
+  case 0x27:
+    /* DAA */
+    daa(cpu);
+    return 4;
+
+  case 0x2f:
+    /* CPL */
+    cpu->a ^= 0xff;
+    cpu->f = (cpu->f & (Z80_SF | Z80_ZF | Z80_PF | Z80_CF)) | Z80_HF | Z80_NF |
+             (cpu->a & (Z80_YF | Z80_XF));
+    return 4;
+
+  case 0x37:
+    /* SCF */
+    cpu->f = (cpu->f & (Z80_SF | Z80_ZF | Z80_PF | Z80_CF)) | Z80_CF |
+             (cpu->a & (Z80_YF | Z80_XF));
+    return 4;
+
+  case 0x3f:
+    /* CCF */
+    cpu->f = ((cpu->f & (Z80_SF | Z80_ZF | Z80_PF | Z80_CF)) |
+              ((cpu->f & Z80_CF) << 4) | (cpu->a & (Z80_YF | Z80_XF))) ^
+             Z80_CF;
+    return 4;
+
+  case 0xc0:
+  case 0xc8:
+  case 0xd0:
+  case 0xd8:
+  case 0xe0:
+  case 0xe8:
+  case 0xf0:
+  case 0xf8:
+    /* RET cc */
+    if (cond(cpu, y)) {
+      cpu->wz = cpu->pc = pop(cpu, bus);
+      return 11;
+    }
+
+    return 5;
+
+  case 0xc1:
+  case 0xd1:
+  case 0xe1:
+  case 0xf1:
+    /* POP rr */
+    set_rp2(cpu, p, idx, pop(cpu, bus));
+    return 10;
+
+  case 0xc5:
+  case 0xd5:
+  case 0xe5:
+  case 0xf5:
+    /* PUSH rr */
+    push(cpu, bus, get_rp2(cpu, p, idx));
+    return 11;
+
+  case 0xc2:
+  case 0xca:
+  case 0xd2:
+  case 0xda:
+  case 0xe2:
+  case 0xea:
+  case 0xf2:
+  case 0xfa:
+    /* JP cc,nn */
+    cpu->wz = imm16(cpu, bus);
+
+    if (cond(cpu, y)) {
+      cpu->pc = cpu->wz;
+    }
+
+    return 10;
+
+  case 0xc3:
+    /* JP nn */
+    cpu->wz = cpu->pc = imm16(cpu, bus);
+    return 10;
+
+  case 0xc4:
+  case 0xcc:
+  case 0xd4:
+  case 0xdc:
+  case 0xe4:
+  case 0xec:
+  case 0xf4:
+  case 0xfc:
+    /* CALL cc,nn */
+    cpu->wz = imm16(cpu, bus);
+
+    if (cond(cpu, y)) {
+      push(cpu, bus, cpu->pc);
+      cpu->pc = cpu->wz;
+      return 17;
+    }
+
+    return 10;
+
+  case 0xcd:
+    /* CALL nn */
+    cpu->wz = imm16(cpu, bus);
+    push(cpu, bus, cpu->pc);
+    cpu->pc = cpu->wz;
+    return 17;
+
+  case 0xc9:
+    /* RET */
+    cpu->wz = cpu->pc = pop(cpu, bus);
+    return 10;
+
+  case 0xc6:
+  case 0xce:
+  case 0xd6:
+  case 0xde:
+  case 0xe6:
+  case 0xee:
+  case 0xf6:
+  case 0xfe:
+    /* ALU A,n */
+    alu8(cpu, y, imm8(cpu, bus));
+    return 7;
+
+  case 0xc7:
+  case 0xcf:
+  case 0xd7:
+  case 0xdf:
+  case 0xe7:
+  case 0xef:
+  case 0xf7:
+  case 0xff:
+    /* RST p */
+    push(cpu, bus, cpu->pc);
+    cpu->wz = cpu->pc = y * 8;
+    return 11;
+
+  case 0xd3: {
+    /* OUT (n),A */
+    uint8_t n = imm8(cpu, bus);
+    bus->io_write(bus->user_data, (cpu->a << 8) | n, cpu->a);
+    cpu->wz = (cpu->a << 8) | ((n + 1) & 0xff);
+    return 11;
+  }
+
+  case 0xdb: {
+    /* IN A,(n) */
+    uint16_t port = (cpu->a << 8) | imm8(cpu, bus);
+    cpu->a = bus->io_read(bus->user_data, port);
+    cpu->wz = port + 1;
+    return 11;
+  }
+
+  case 0xd9: {
+    /* EXX */
+    uint16_t tmp;
+    tmp = cpu->bc;
+    cpu->bc = cpu->bc2;
+    cpu->bc2 = tmp;
+    tmp = cpu->de;
+    cpu->de = cpu->de2;
+    cpu->de2 = tmp;
+    tmp = cpu->hl;
+    cpu->hl = cpu->hl2;
+    cpu->hl2 = tmp;
+    return 4;
+  }
+
+  case 0xe3: {
+    /* EX (SP),HL */
+    uint16_t val = rd16(bus, cpu->sp);
+    wr16(bus, cpu->sp, cpu->hlx[idx].hl);
+    cpu->wz = cpu->hlx[idx].hl = val;
+    return 19;
+  }
+
+  case 0xe9:
+    /* JP (HL) */
+    cpu->pc = cpu->hlx[idx].hl;
+    return 4;
+
+  case 0xeb: {
+    /* EX DE,HL (never rewired to IX/IY) */
+    uint16_t tmp = cpu->hl;
+    cpu->hl = cpu->de;
+    cpu->de = tmp;
+    return 4;
+  }
+
+  case 0xf3:
+    /* DI */
+    cpu->iff1 = cpu->iff2 = false;
+    return 4;
+
+  case 0xfb:
+    /* EI */
+    cpu->iff1 = cpu->iff2 = true;
+    cpu->pins |= Z80_STEP_EI;
+    return 4;
+
+  case 0xf9:
+    /* LD SP,HL */
+    cpu->sp = cpu->hlx[idx].hl;
+    return 6;
+
+  default:
+    /* the prefixes are handled in dispatch */
+    return 4;
+  }
+}
+
+/* executes an instruction, given its first opcode byte */
+static int dispatch(z80_t *cpu, const z80_bus_t *bus, uint8_t op) {
+  int ticks = 0;
+  int idx = 0;
+
+  /* a DD/FD prefix replaces HL with IX/IY, and only the last one counts */
+  while (op == 0xdd || op == 0xfd) {
+    idx = (op == 0xdd) ? 1 : 2;
+    ticks += 4;
+    op = fetch(cpu, bus);
+  }
+
+  switch (op) {
+  case 0xcb:
+    if (idx) {
+      return ticks + exec_ddfdcb(cpu, bus, idx);
+    }
+    return ticks + exec_cb(cpu, bus, fetch(cpu, bus));
+  case 0xed:
+    return ticks + exec_ed(cpu, bus, fetch(cpu, bus));
+  default:
+    return ticks + exec(cpu, bus, op, idx);
+  }
+}
+
+/* leaves the halt state when an interrupt is accepted */
+static inline void unhalt(z80_t *cpu) {
+  if (cpu->pins & Z80_STEP_HALT) {
+    cpu->pins &= ~Z80_STEP_HALT;
+    cpu->pc++;
+  }
+}
+
+int z80_step(z80_t *cpu, const z80_bus_t *bus, uint64_t pins) {
+  uint64_t state = cpu->pins;
+
+  cpu->pins = (state & ~(Z80_STEP_NMI | Z80_STEP_EI)) | (pins & Z80_NMI);
+
+  /* a non-maskable interrupt is triggered by a rising edge on the NMI pin */
+  if (pins & ~state & Z80_NMI) {
+    unhalt(cpu);
+    cpu->iff1 = false;
+    cpu->r = (cpu->r & 0x80) | ((cpu->r + 1) & 0x7f);
+    push(cpu, bus, cpu->pc);
+    cpu->wz = cpu->pc = 0x0066;
+    return 11;
+  }
+
+  /* maskable interrupts are held off for one instruction after EI */
+  if ((pins & Z80_INT) && cpu->iff1 && !(state & Z80_STEP_EI)) {
+    unhalt(cpu);
+    cpu->iff1 = cpu->iff2 = false;
+
+    uint8_t data = bus->int_ack(bus->user_data);
+    cpu->r = (cpu->r & 0x80) | ((cpu->r + 1) & 0x7f);
+
+    switch (cpu->im) {
+    case 0:
+      /* execute the instruction on the data bus */
+      return 2 + dispatch(cpu, bus, data);
+    case 1:
+      push(cpu, bus, cpu->pc);
+      cpu->wz = cpu->pc = 0x0038;
+      return 13;
+    default:
+      push(cpu, bus, cpu->pc);
+      cpu->wz = cpu->pc = rd16(bus, (cpu->i << 8) | data);
+      return 19;
+    }
+  }
+
+  return dispatch(cpu, bus, fetch(cpu, bus));
+}
@@ -0,0 +1,101 @@
+/*
+ *   __   __     __  __     __         __
+ *  /\ "-.\ \   /\ \/\ \   /\ \       /\ \
+ *  \ \ \-.  \  \ \ \_\ \  \ \ \____  \ \ \____
+ *   \ \_\\"\_\  \ \_____\  \ \_____\  \ \_____\
+ *    \/_/ \/_/   \/_____/   \/_____/   \/_____/
+ *   ______     ______       __     ______     ______     ______
+ *  /\  __ \   /\  == \     /\ \   /\  ___\   /\  ___\   /\__  _\
+ *  \ \ \/\ \  \ \  __<    _\_\ \  \ \  __\   \ \ \____  \/_/\ \/
+ *   \ \_____\  \ \_____\ /\_____\  \ \_____\  \ \_____\    \ \_\
+ *    \/_____/   \/_____/ \/_____/   \/_____/   \/_____/     \/_/
+ *
+ * https://joshbassett.info
+ *
+ * Copyright (c) 2025 Joshua Bassett
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chips/mem.h"
+#include "chips/z80.h"
+
+/* The instruction-stepped core shares the z80_t register state with the
+ * cycle-stepped core in chips/z80.h, so a machine can switch between them on
+ * an instruction boundary. Rather than driving the pin mask on every tick, it
+ * executes a whole instruction per call and accesses memory and I/O through
+ * direct callbacks. Plain RAM and ROM pages can optionally be accessed
+ * through a mem_t page table, bypassing the callbacks altogether.
+ *
+ * The core uses the following bits in the z80_t pins field to track its
+ * state between calls: */
+
+/* the HALT instruction is active */
+#define Z80_STEP_HALT Z80_HALT
+
+/* the last NMI pin state, used for edge detection */
+#define Z80_STEP_NMI Z80_NMI
+
+/* an EI instruction was just executed, so interrupts are held off for one
+ * instruction */
+#define Z80_STEP_EI (1ULL << 40)
+
+/* memory and I/O callbacks */
+typedef struct {
+  /* reads a byte from memory */
+  uint8_t (*mem_read)(void *user_data, uint16_t addr);
+
+  /* writes a byte to memory */
+  void (*mem_write)(void *user_data, uint16_t addr, uint8_t data);
+
+  /* reads a byte from an I/O port */
+  uint8_t (*io_read)(void *user_data, uint16_t port);
+
+  /* writes a byte to an I/O port */
+  void (*io_write)(void *user_data, uint16_t port, uint8_t data);
+
+  /* acknowledges a maskable interrupt, and returns the byte on the data bus
+   * (used in interrupt modes 0 and 2) */
+  uint8_t (*int_ack)(void *user_data);
+
+  /* passed to the callbacks */
+  void *user_data;
+
+  /* the memory map for direct accesses (optional) */
+  mem_t *mem;
+
+  /* bit masks of the pages which are read and written directly through the
+   * memory map, all other pages go through the callbacks */
+  uint64_t direct_read;
+  uint64_t direct_write;
+} z80_bus_t;
+
+/**
+ * Executes a single instruction, or accepts a pending interrupt, and returns
+ * the number of ticks taken.
+ *
+ * The INT and NMI pins in the given pin mask are the state of the interrupt
+ * request lines. Interrupts are only checked on instruction boundaries.
+ */
+int z80_step(z80_t *cpu, const z80_bus_t *bus, uint64_t pins);